@@ -0,0 +1,69 @@
+#include "channel_registry.hpp"
+#include "tdms_channel.h"
+
+namespace TDMS {
+
+  namespace {
+    // slots in a new table
+    const size_t initial_slots = 64;
+  }
+
+  channel_registry::channel_registry( ) : _slots( initial_slots, npos ) { }
+
+  channel_registry::~channel_registry( ) { }
+
+  uint64_t channel_registry::_hash( std::string_view path ) {
+    // 64-bit FNV-1a
+    uint64_t h = 0xcbf29ce484222325ull;
+    for ( unsigned char c : path ) {
+      h = ( h ^ c ) * 0x100000001b3ull;
+    }
+    return h;
+  }
+
+  size_t channel_registry::_slot( std::string_view path, uint64_t hash ) const {
+    // linear probing; the table is never full, so this finds an empty slot
+    // if it doesn't find the path
+    size_t mask = _slots.size( ) - 1;
+    for ( size_t i = hash & mask;; i = ( i + 1 ) & mask ) {
+      uint32_t id = _slots[i];
+      if ( npos == id || ( _hashes[id] == hash && _channels[id]->get_path( ) == path ) ) {
+        return i;
+      }
+    }
+  }
+
+  uint32_t channel_registry::find( std::string_view path ) const {
+    return _slots[_slot( path, _hash( path ) )];
+  }
+
+  uint32_t channel_registry::add( std::unique_ptr<channel> c ) {
+    if ( 2 * ( _channels.size( ) + 1 ) > _slots.size( ) ) {
+      _grow( );
+    }
+    uint64_t hash = _hash( c->get_path( ) );
+    uint32_t id = _channels.size( );
+    _slots[_slot( c->get_path( ), hash )] = id;
+    _channels.push_back( std::move( c ) );
+    _hashes.push_back( hash );
+    return id;
+  }
+
+  void channel_registry::_grow( ) {
+    std::vector<uint32_t>( _slots.size( ) * 2, npos ).swap( _slots );
+    size_t mask = _slots.size( ) - 1;
+    for ( uint32_t id = 0; id < _channels.size( ); ++id ) {
+      size_t i = _hashes[id] & mask;
+      while ( npos != _slots[i] ) {
+        i = ( i + 1 ) & mask;
+      }
+      _slots[i] = id;
+    }
+  }
+
+  void channel_registry::clear( ) {
+    _channels.clear( );
+    _hashes.clear( );
+    std::vector<uint32_t>( initial_slots, npos ).swap( _slots );
+  }
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "tdms_exports.h"
+
+namespace TDMS {
+
+  class channel;
+
+  /**
+   * The channels (and other objects) of a file. Each one gets the next
+   * ID of a dense run from 0 as it is added, and is found by its path
+   * through an open-addressed table of those IDs, hashed on the bytes of
+   * the path, so finding a channel needs no std::string of its path.
+   */
+  class channel_registry {
+  public:
+    static constexpr uint32_t npos = 0xFFFFFFFF;
+
+    TDMS_EXPORT channel_registry( );
+    TDMS_EXPORT ~channel_registry( );
+
+    // the ID of the channel with the given path, or npos if there's none
+    TDMS_EXPORT uint32_t find( std::string_view path ) const;
+
+    // adds a channel whose path isn't in the registry yet, returning its ID
+    TDMS_EXPORT uint32_t add( std::unique_ptr<channel> c );
+
+    channel * operator[]( uint32_t id ) const {
+      return _channels[id].get( );
+    }
+
+    size_t size( ) const {
+      return _channels.size( );
+    }
+
+    TDMS_EXPORT void clear( );
+
+  private:
+    static uint64_t _hash( std::string_view path );
+    // the slot holding the channel with the path, or the empty slot
+    // where it would go
+    size_t _slot( std::string_view path, uint64_t hash ) const;
+    void _grow( );
+
+    std::vector<std::unique_ptr<channel>> _channels;
+    // the hashes of the channels' paths, by ID, so growing the table
+    // doesn't hash them all again
+    std::vector<uint64_t> _hashes;
+    // channel IDs, or npos for empty slots; a power of two of them, at
+    // most half full
+    std::vector<uint32_t> _slots;
+  };
+}
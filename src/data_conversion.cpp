@@ -0,0 +1,162 @@
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <algorithm>
+
+#include "data_conversion.hpp"
+#include "data_kernels.hpp"
+#include "data_scaling.hpp"
+#include "data_type.h"
+
+namespace TDMS {
+
+  namespace {
+
+    // the integers and the floats, with units or without
+    bool is_numeric( uint32_t type ) {
+      return ( ( type >= tdsTypeI8 && type <= tdsTypeDoubleFloat )
+          || tdsTypeSingleFloatWithUnit == type || tdsTypeDoubleFloatWithUnit == type );
+    }
+
+    template<typename To, typename From>
+    To narrow( From value ) {
+      if constexpr ( std::is_floating_point<From>::value && std::is_integral<To>::value ) {
+        // out of range conversions are undefined, so saturate
+        if ( value != value ) {
+          return 0;
+        }
+        if ( value <= (From) std::numeric_limits<To>::min( ) ) {
+          return std::numeric_limits<To>::min( );
+        }
+        if ( value >= (From) std::numeric_limits<To>::max( ) ) {
+          return std::numeric_limits<To>::max( );
+        }
+      }
+      return (To) value;
+    }
+
+    template<typename From, typename To>
+    void convert_values( const unsigned char * src, size_t count, To * dst ) {
+      for ( size_t i = 0; i < count; ++i ) {
+        From value;
+        memcpy( &value, src + i * sizeof ( From ), sizeof ( From ) );
+        dst[i] = narrow<To>( value );
+      }
+    }
+
+    template<typename To>
+    void convert_to( const unsigned char * src, uint32_t from, size_t count, To * dst ) {
+      switch ( from ) {
+        case tdsTypeI8:
+          convert_values<int8_t>( src, count, dst );
+          break;
+        case tdsTypeI16:
+          convert_values<int16_t>( src, count, dst );
+          break;
+        case tdsTypeI32:
+          convert_values<int32_t>( src, count, dst );
+          break;
+        case tdsTypeI64:
+          convert_values<int64_t>( src, count, dst );
+          break;
+        case tdsTypeU8:
+          convert_values<uint8_t>( src, count, dst );
+          break;
+        case tdsTypeU16:
+          convert_values<uint16_t>( src, count, dst );
+          break;
+        case tdsTypeU32:
+          convert_values<uint32_t>( src, count, dst );
+          break;
+        case tdsTypeU64:
+          convert_values<uint64_t>( src, count, dst );
+          break;
+        case tdsTypeSingleFloat:
+        case tdsTypeSingleFloatWithUnit:
+          convert_values<float>( src, count, dst );
+          break;
+        case tdsTypeDoubleFloat:
+        case tdsTypeDoubleFloatWithUnit:
+          convert_values<double>( src, count, dst );
+          break;
+        case tdsTypeExtendedFloat:
+        case tdsTypeExtendedFloatWithUnit:
+        {
+          // decode them to double first, a block at a time
+          double block[256];
+          for ( size_t i = 0; i < count; i += 256 ) {
+            size_t n = std::min<size_t>( 256, count - i );
+            extended_to_double( src + i * 16, n, block );
+            convert_values<double>( (const unsigned char *) block, n, dst + i );
+          }
+          break;
+        }
+      }
+    }
+
+    std::string type_name( uint32_t type ) {
+      return data_type_t( (tds_type_code) type ).name( );
+    }
+  }
+
+  bool is_convertible( uint32_t from, uint32_t to ) {
+    return ( ( is_numeric( from ) || tdsTypeExtendedFloat == from || tdsTypeExtendedFloatWithUnit == from ) && is_numeric( to ) );
+  }
+
+  void convert( const unsigned char * src, uint32_t from, size_t count,
+      void * dst, uint32_t to, const scaling * scale ) {
+    if ( !is_convertible( from, to ) ) {
+      throw std::runtime_error( "Can't convert " + type_name( from ) + " values to " + type_name( to ) );
+    }
+    tds_type_code source = (tds_type_code) from;
+    if ( nullptr != scale ) {
+      if ( tdsTypeDoubleFloat == to || tdsTypeDoubleFloatWithUnit == to ) {
+        scale->apply( src, source, count, (double *) dst );
+      }
+      else if ( tdsTypeSingleFloat == to || tdsTypeSingleFloatWithUnit == to ) {
+        scale->apply( src, source, count, (float *) dst );
+      }
+      else {
+        throw std::runtime_error( "Scaled values can't be converted to " + type_name( to ) );
+      }
+      return;
+    }
+
+    switch ( to ) {
+      case tdsTypeI8:
+        convert_to( src, from, count, (int8_t *) dst );
+        break;
+      case tdsTypeI16:
+        convert_to( src, from, count, (int16_t *) dst );
+        break;
+      case tdsTypeI32:
+        convert_to( src, from, count, (int32_t *) dst );
+        break;
+      case tdsTypeI64:
+        convert_to( src, from, count, (int64_t *) dst );
+        break;
+      case tdsTypeU8:
+        convert_to( src, from, count, (uint8_t *) dst );
+        break;
+      case tdsTypeU16:
+        convert_to( src, from, count, (uint16_t *) dst );
+        break;
+      case tdsTypeU32:
+        convert_to( src, from, count, (uint32_t *) dst );
+        break;
+      case tdsTypeU64:
+        convert_to( src, from, count, (uint64_t *) dst );
+        break;
+      case tdsTypeSingleFloat:
+      case tdsTypeSingleFloatWithUnit:
+        to_float( src, source, count, (float *) dst );
+        break;
+      case tdsTypeDoubleFloat:
+      case tdsTypeDoubleFloatWithUnit:
+        to_double( src, source, count, (double *) dst );
+        break;
+    }
+  }
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#include "tdms_exports.h"
+
+namespace TDMS {
+
+  struct scaling;
+
+  /**
+   * Whether values of the TDMS type from can be converted to the TDMS
+   * type to: both have to be numeric (tdsTypeI8 to tdsTypeDoubleFloat,
+   * the floats with units, and the extended floats as a source).
+   */
+  TDMS_EXPORT bool is_convertible( uint32_t from, uint32_t to );
+
+  /**
+   * Converts count little-endian values of the TDMS type from to the C
+   * type of the TDMS type to, in a single pass. Conversions to float and
+   * double are vectorized. Conversions to integer types are not: they
+   * work a value at a time and behave like C casts, except that floating
+   * point values saturate at the ends of the integer type's range and
+   * NaN becomes 0. If scale isn't null, the values are scaled on the
+   * way, which needs a float or double target. Throws if the types can't
+   * be converted.
+   */
+  TDMS_EXPORT void convert( const unsigned char * src, uint32_t from, size_t count,
+      void * dst, uint32_t to, const scaling * scale = nullptr );
+}
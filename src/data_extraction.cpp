@@ -5,22 +5,49 @@
  */
 
 #include "data_extraction.hpp"
+#include "data_kernels.hpp"
 #include <cstring>
 
 namespace TDMS{
 
   time_t read_timestamp( const unsigned char* p ) {
-    //unsigned long long fraction = read_le<uint64_t>( p ); // time_t doesn't support ms resolution
-    long long secsSince1904 = read_le<int64_t>( p + sizeof (uint64_t ) );
-    time_t result = secsSince1904 - 2082844800; // tdms epoch is 1/1/1904, not 1/1/1970
-    return result;
+    // time_t doesn't have the fraction; read_le_timestamp keeps it
+    return read_le_timestamp( p ).unix_time( );
   }
 
-  std::string read_string( const unsigned char* p ) {
-    uint32_t len = read_le<uint32_t>( p );
+  timestamp read_le_timestamp( const unsigned char* p ) {
+    timestamp t;
+    t.fraction = read_le<uint64_t>( p );
+    t.seconds = read_le<int64_t>( p + sizeof (uint64_t ) );
+    return t;
+  }
+
+  time_t timestamp::unix_time( ) const {
+    return seconds - 2082844800; // tdms epoch is 1/1/1904, not 1/1/1970
+  }
+
+  int64_t timestamp::nanoseconds( ) const {
+    int64_t ns;
+    timestamps_to_nanoseconds( (const unsigned char*) this, 1, &ns );
+    return ns;
+  }
+
+  double timestamp::unix_seconds( ) const {
+    double s;
+    timestamps_to_seconds( (const unsigned char*) this, 1, &s );
+    return s;
+  }
+
+  std::string read_string( const unsigned char* p, endianness e ) {
+    uint32_t len = read_as<uint32_t>( p, e );
     return std::string( (const char*) p + 4, len );
   }
 
+  std::string_view read_string_view( const unsigned char* p, endianness e ) {
+    uint32_t len = read_as<uint32_t>( p, e );
+    return std::string_view( (const char*) p + 4, len );
+  }
+
   double read_le_double( const unsigned char* p ) {
     double a;
     char* b = (char*) (double*) &a;
@@ -38,4 +65,10 @@ namespace TDMS{
     memcpy( b, p, sizeof (float ) );
     return a;
   }
-}
\ No newline at end of file
+
+  double read_le_extended( const unsigned char* p ) {
+    double a;
+    extended_to_double( p, 1, &a );
+    return a;
+  }
+}
@@ -4,11 +4,19 @@
 #define EXTRACTION_H
 
 #include <ctime>
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include "log.hpp"
+#include "tdms_exports.h"
 
 namespace TDMS {
 
+  enum class endianness {
+    BIG,
+    LITTLE
+  };
+
   template<typename T>
   T read_le( const unsigned char* p ) {
     T sum = p[0];
@@ -18,14 +26,54 @@ namespace TDMS {
     return sum;
   }
 
+  template<typename T>
+  T read_be( const unsigned char* p ) {
+    T sum = p[sizeof (T ) - 1];
+    for ( size_t i = 1; i < sizeof (T ); ++i ) {
+      sum |= T( p[sizeof (T ) - 1 - i] ) << ( 8 * i );
+    }
+    return sum;
+  }
+
+  template<typename T>
+  T read_as( const unsigned char* p, endianness e ) {
+    return ( endianness::BIG == e ? read_be<T>( p ) : read_le<T>( p ) );
+  }
 
-  std::string read_string( const unsigned char* p );
+
+  std::string read_string( const unsigned char* p, endianness e = endianness::LITTLE );
+
+  // the string at p, without copying it out of the buffer
+  std::string_view read_string_view( const unsigned char* p, endianness e = endianness::LITTLE );
 
   double read_le_double( const unsigned char* p );
 
   float read_le_float( const unsigned char* p );
 
+  // an 80-bit extended precision float, in 16 bytes
+  double read_le_extended( const unsigned char* p );
+
   time_t read_timestamp( const unsigned char* p );
+
+  /**
+   * A TDMS timestamp, laid out as it's stored: fractions of a second, in
+   * units of 2^-64 s, then whole seconds since 1904-01-01 00:00 UTC
+   */
+  struct timestamp {
+    uint64_t fraction;
+    int64_t seconds;
+
+    // seconds since the Unix epoch, without the fraction
+    TDMS_EXPORT time_t unix_time( ) const;
+
+    // nanoseconds since the Unix epoch, rounded to nearest
+    TDMS_EXPORT int64_t nanoseconds( ) const;
+
+    // seconds since the Unix epoch
+    TDMS_EXPORT double unix_seconds( ) const;
+  };
+
+  timestamp read_le_timestamp( const unsigned char* p );
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,746 @@
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <cmath>
+
+#include "data_kernels.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 )
+#define TDMS_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace TDMS {
+
+  namespace {
+
+#ifdef TDMS_SSE2
+
+    // interleaves the low (or high) halves of two vectors, W bytes at a time
+    template<size_t W> __m128i unpacklo( __m128i a, __m128i b );
+    template<size_t W> __m128i unpackhi( __m128i a, __m128i b );
+
+    template<> __m128i unpacklo<1>( __m128i a, __m128i b ) {
+      return _mm_unpacklo_epi8( a, b );
+    }
+
+    template<> __m128i unpackhi<1>( __m128i a, __m128i b ) {
+      return _mm_unpackhi_epi8( a, b );
+    }
+
+    template<> __m128i unpacklo<2>( __m128i a, __m128i b ) {
+      return _mm_unpacklo_epi16( a, b );
+    }
+
+    template<> __m128i unpackhi<2>( __m128i a, __m128i b ) {
+      return _mm_unpackhi_epi16( a, b );
+    }
+
+    template<> __m128i unpacklo<4>( __m128i a, __m128i b ) {
+      return _mm_unpacklo_epi32( a, b );
+    }
+
+    template<> __m128i unpackhi<4>( __m128i a, __m128i b ) {
+      return _mm_unpackhi_epi32( a, b );
+    }
+
+    template<> __m128i unpacklo<8>( __m128i a, __m128i b ) {
+      return _mm_unpacklo_epi64( a, b );
+    }
+
+    template<> __m128i unpackhi<8>( __m128i a, __m128i b ) {
+      return _mm_unpackhi_epi64( a, b );
+    }
+
+    // Transposes a square block of 16/W rows of 16/W elements each, one row
+    // per vector. Each pass pairs row i with row i + N/2 and interleaves
+    // them, and after log2(N) passes the rows have become the columns.
+    template<size_t W>
+    void transpose_block( __m128i * v ) {
+      const size_t N = 16 / W;
+      for ( size_t pass = 1; pass < N; pass *= 2 ) {
+        __m128i t[N];
+        for ( size_t i = 0; i < N / 2; ++i ) {
+          t[2 * i] = unpacklo<W>( v[i], v[i + N / 2] );
+          t[2 * i + 1] = unpackhi<W>( v[i], v[i + N / 2] );
+        }
+        for ( size_t i = 0; i < N; ++i ) {
+          v[i] = t[i];
+        }
+      }
+    }
+
+    template<>
+    void transpose_block<16>( __m128i * ) {
+      // one element per vector, so there's nothing to shuffle
+    }
+#endif
+
+    template<size_t W>
+    void deinterleave_fixed( const unsigned char * src, size_t rows, size_t cols,
+        unsigned char * const * columns ) {
+      const size_t stride = cols * W;
+      size_t r = 0;
+
+#ifdef TDMS_SSE2
+      // whole blocks of N rows and N columns, with what's left of the
+      // columns done one element at a time
+      const size_t N = 16 / W;
+      for ( ; r + N <= rows; r += N ) {
+        const unsigned char * row = src + r * stride;
+        size_t c = 0;
+        for ( ; c + N <= cols; c += N ) {
+          __m128i v[N];
+          for ( size_t i = 0; i < N; ++i ) {
+            v[i] = _mm_loadu_si128( (const __m128i *) ( row + i * stride + c * W ) );
+          }
+          transpose_block<W>( v );
+          for ( size_t i = 0; i < N; ++i ) {
+            _mm_storeu_si128( (__m128i *) ( columns[c + i] + r * W ), v[i] );
+          }
+        }
+        for ( ; c < cols; ++c ) {
+          for ( size_t i = 0; i < N; ++i ) {
+            memcpy( columns[c] + ( r + i ) * W, row + i * stride + c * W, W );
+          }
+        }
+      }
+#endif
+
+      for ( ; r < rows; ++r ) {
+        const unsigned char * row = src + r * stride;
+        for ( size_t c = 0; c < cols; ++c ) {
+          memcpy( columns[c] + r * W, row + c * W, W );
+        }
+      }
+    }
+
+#ifdef TDMS_SSE2
+    // reverses the bytes of each W-byte element of a vector
+    template<size_t W> __m128i swap_vector( __m128i v );
+
+    template<> __m128i swap_vector<2>( __m128i v ) {
+      return _mm_or_si128( _mm_slli_epi16( v, 8 ), _mm_srli_epi16( v, 8 ) );
+    }
+
+    template<> __m128i swap_vector<4>( __m128i v ) {
+      v = _mm_shufflelo_epi16( v, _MM_SHUFFLE( 2, 3, 0, 1 ) );
+      v = _mm_shufflehi_epi16( v, _MM_SHUFFLE( 2, 3, 0, 1 ) );
+      return swap_vector<2>( v );
+    }
+
+    template<> __m128i swap_vector<8>( __m128i v ) {
+      v = _mm_shufflelo_epi16( v, _MM_SHUFFLE( 0, 1, 2, 3 ) );
+      v = _mm_shufflehi_epi16( v, _MM_SHUFFLE( 0, 1, 2, 3 ) );
+      return swap_vector<2>( v );
+    }
+
+    template<> __m128i swap_vector<16>( __m128i v ) {
+      return swap_vector<8>( _mm_shuffle_epi32( v, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+    }
+#endif
+
+    template<size_t W>
+    void byteswap_fixed( const unsigned char * src, size_t count, unsigned char * dst ) {
+      size_t i = 0;
+#ifdef TDMS_SSE2
+      for ( ; ( i + 16 / W ) <= count; i += 16 / W ) {
+        __m128i v = _mm_loadu_si128( (const __m128i *) ( src + i * W ) );
+        _mm_storeu_si128( (__m128i *) ( dst + i * W ), swap_vector<W>( v ) );
+      }
+#endif
+      for ( ; i < count; ++i ) {
+        unsigned char tmp[W];
+        for ( size_t b = 0; b < W; ++b ) {
+          tmp[b] = src[i * W + W - 1 - b];
+        }
+        memcpy( dst + i * W, tmp, W );
+      }
+    }
+
+    // the values from i on, a value at a time
+    template<typename T>
+    void to_double_from( const unsigned char * src, size_t i, size_t count, double * dst ) {
+      for ( ; i < count; ++i ) {
+        T value;
+        memcpy( &value, src + i * sizeof ( T ), sizeof ( T ) );
+        dst[i] = (double) value;
+      }
+    }
+
+#ifdef TDMS_SSE2
+    void store_i32( __m128i v, double * dst ) {
+      _mm_storeu_pd( dst, _mm_cvtepi32_pd( v ) );
+      _mm_storeu_pd( dst + 2, _mm_cvtepi32_pd( _mm_shuffle_epi32( v, _MM_SHUFFLE( 1, 0, 3, 2 ) ) ) );
+    }
+
+    void store_i16( __m128i v, double * dst ) {
+      // sign-extend by putting each value in the top half and shifting back
+      store_i32( _mm_srai_epi32( _mm_unpacklo_epi16( v, v ), 16 ), dst );
+      store_i32( _mm_srai_epi32( _mm_unpackhi_epi16( v, v ), 16 ), dst + 4 );
+    }
+
+    void store_u16( __m128i v, double * dst ) {
+      __m128i zero = _mm_setzero_si128( );
+      store_i32( _mm_unpacklo_epi16( v, zero ), dst );
+      store_i32( _mm_unpackhi_epi16( v, zero ), dst + 4 );
+    }
+#endif
+
+    void i8_to_double( const unsigned char * src, size_t count, double * dst ) {
+      size_t i = 0;
+#ifdef TDMS_SSE2
+      for ( ; i + 16 <= count; i += 16 ) {
+        __m128i v = _mm_loadu_si128( (const __m128i *) ( src + i ) );
+        store_i16( _mm_srai_epi16( _mm_unpacklo_epi8( v, v ), 8 ), dst + i );
+        store_i16( _mm_srai_epi16( _mm_unpackhi_epi8( v, v ), 8 ), dst + i + 8 );
+      }
+#endif
+      to_double_from<int8_t>( src, i, count, dst );
+    }
+
+    void u8_to_double( const unsigned char * src, size_t count, double * dst ) {
+      size_t i = 0;
+#ifdef TDMS_SSE2
+      __m128i zero = _mm_setzero_si128( );
+      for ( ; i + 16 <= count; i += 16 ) {
+        __m128i v = _mm_loadu_si128( (const __m128i *) ( src + i ) );
+        store_u16( _mm_unpacklo_epi8( v, zero ), dst + i );
+        store_u16( _mm_unpackhi_epi8( v, zero ), dst + i + 8 );
+      }
+#endif
+      to_double_from<uint8_t>( src, i, count, dst );
+    }
+
+    void i16_to_double( const unsigned char * src, size_t count, double * dst ) {
+      size_t i = 0;
+#ifdef TDMS_SSE2
+      for ( ; i + 8 <= count; i += 8 ) {
+        store_i16( _mm_loadu_si128( (const __m128i *) ( src + i * 2 ) ), dst + i );
+      }
+#endif
+      to_double_from<int16_t>( src, i, count, dst );
+    }
+
+    void u16_to_double( const unsigned char * src, size_t count, double * dst ) {
+      size_t i = 0;
+#ifdef TDMS_SSE2
+      for ( ; i + 8 <= count; i += 8 ) {
+        store_u16( _mm_loadu_si128( (const __m128i *) ( src + i * 2 ) ), dst + i );
+      }
+#endif
+      to_double_from<uint16_t>( src, i, count, dst );
+    }
+
+    void i32_to_double( const unsigned char * src, size_t count, double * dst ) {
+      size_t i = 0;
+#ifdef TDMS_SSE2
+      for ( ; i + 4 <= count; i += 4 ) {
+        store_i32( _mm_loadu_si128( (const __m128i *) ( src + i * 4 ) ), dst + i );
+      }
+#endif
+      to_double_from<int32_t>( src, i, count, dst );
+    }
+
+    void u32_to_double( const unsigned char * src, size_t count, double * dst ) {
+      size_t i = 0;
+#ifdef TDMS_SSE2
+      // there's no unsigned conversion, so shift the values into the
+      // signed range and back again
+      const __m128i bias = _mm_set1_epi32( (int) 0x80000000u );
+      const __m128d offset = _mm_set1_pd( 2147483648.0 );
+      for ( ; i + 4 <= count; i += 4 ) {
+        __m128i v = _mm_xor_si128( _mm_loadu_si128( (const __m128i *) ( src + i * 4 ) ), bias );
+        _mm_storeu_pd( dst + i, _mm_add_pd( _mm_cvtepi32_pd( v ), offset ) );
+        _mm_storeu_pd( dst + i + 2, _mm_add_pd(
+            _mm_cvtepi32_pd( _mm_shuffle_epi32( v, _MM_SHUFFLE( 1, 0, 3, 2 ) ) ), offset ) );
+      }
+#endif
+      to_double_from<uint32_t>( src, i, count, dst );
+    }
+
+    void f32_to_double( const unsigned char * src, size_t count, double * dst ) {
+      size_t i = 0;
+#ifdef TDMS_SSE2
+      for ( ; i + 4 <= count; i += 4 ) {
+        __m128 v = _mm_loadu_ps( (const float *) ( src + i * 4 ) );
+        _mm_storeu_pd( dst + i, _mm_cvtps_pd( v ) );
+        _mm_storeu_pd( dst + i + 2, _mm_cvtps_pd( _mm_movehl_ps( v, v ) ) );
+      }
+#endif
+      to_double_from<float>( src, i, count, dst );
+    }
+
+    template<typename T>
+    void to_float_from( const unsigned char * src, size_t i, size_t count, float * dst ) {
+      for ( ; i < count; ++i ) {
+        T value;
+        memcpy( &value, src + i * sizeof ( T ), sizeof ( T ) );
+        dst[i] = (float) value;
+      }
+    }
+
+#ifdef TDMS_SSE2
+    void store_i16_ps( __m128i v, float * dst ) {
+      _mm_storeu_ps( dst, _mm_cvtepi32_ps( _mm_srai_epi32( _mm_unpacklo_epi16( v, v ), 16 ) ) );
+      _mm_storeu_ps( dst + 4, _mm_cvtepi32_ps( _mm_srai_epi32( _mm_unpackhi_epi16( v, v ), 16 ) ) );
+    }
+
+    void store_u16_ps( __m128i v, float * dst ) {
+      __m128i zero = _mm_setzero_si128( );
+      _mm_storeu_ps( dst, _mm_cvtepi32_ps( _mm_unpacklo_epi16( v, zero ) ) );
+      _mm_storeu_ps( dst + 4, _mm_cvtepi32_ps( _mm_unpackhi_epi16( v, zero ) ) );
+    }
+#endif
+
+    void i8_to_float( const unsigned char * src, size_t count, float * dst ) {
+      size_t i = 0;
+#ifdef TDMS_SSE2
+      for ( ; i + 16 <= count; i += 16 ) {
+        __m128i v = _mm_loadu_si128( (const __m128i *) ( src + i ) );
+        store_i16_ps( _mm_srai_epi16( _mm_unpacklo_epi8( v, v ), 8 ), dst + i );
+        store_i16_ps( _mm_srai_epi16( _mm_unpackhi_epi8( v, v ), 8 ), dst + i + 8 );
+      }
+#endif
+      to_float_from<int8_t>( src, i, count, dst );
+    }
+
+    void u8_to_float( const unsigned char * src, size_t count, float * dst ) {
+      size_t i = 0;
+#ifdef TDMS_SSE2
+      __m128i zero = _mm_setzero_si128( );
+      for ( ; i + 16 <= count; i += 16 ) {
+        __m128i v = _mm_loadu_si128( (const __m128i *) ( src + i ) );
+        store_u16_ps( _mm_unpacklo_epi8( v, zero ), dst + i );
+        store_u16_ps( _mm_unpackhi_epi8( v, zero ), dst + i + 8 );
+      }
+#endif
+      to_float_from<uint8_t>( src, i, count, dst );
+    }
+
+    void i16_to_float( const unsigned char * src, size_t count, float * dst ) {
+      size_t i = 0;
+#ifdef TDMS_SSE2
+      for ( ; i + 8 <= count; i += 8 ) {
+        store_i16_ps( _mm_loadu_si128( (const __m128i *) ( src + i * 2 ) ), dst + i );
+      }
+#endif
+      to_float_from<int16_t>( src, i, count, dst );
+    }
+
+    void u16_to_float( const unsigned char * src, size_t count, float * dst ) {
+      size_t i = 0;
+#ifdef TDMS_SSE2
+      for ( ; i + 8 <= count; i += 8 ) {
+        store_u16_ps( _mm_loadu_si128( (const __m128i *) ( src + i * 2 ) ), dst + i );
+      }
+#endif
+      to_float_from<uint16_t>( src, i, count, dst );
+    }
+
+    void i32_to_float( const unsigned char * src, size_t count, float * dst ) {
+      size_t i = 0;
+#ifdef TDMS_SSE2
+      for ( ; i + 4 <= count; i += 4 ) {
+        _mm_storeu_ps( dst + i, _mm_cvtepi32_ps( _mm_loadu_si128( (const __m128i *) ( src + i * 4 ) ) ) );
+      }
+#endif
+      to_float_from<int32_t>( src, i, count, dst );
+    }
+
+    void u32_to_float( const unsigned char * src, size_t count, float * dst ) {
+      size_t i = 0;
+#ifdef TDMS_SSE2
+      // convert the 16-bit halves, which is exact, so that adding them up
+      // rounds only once
+      const __m128i low_mask = _mm_set1_epi32( 0xFFFF );
+      const __m128 shift = _mm_set1_ps( 65536.0f );
+      for ( ; i + 4 <= count; i += 4 ) {
+        __m128i v = _mm_loadu_si128( (const __m128i *) ( src + i * 4 ) );
+        __m128 high = _mm_cvtepi32_ps( _mm_srli_epi32( v, 16 ) );
+        __m128 low = _mm_cvtepi32_ps( _mm_and_si128( v, low_mask ) );
+        _mm_storeu_ps( dst + i, _mm_add_ps( _mm_mul_ps( high, shift ), low ) );
+      }
+#endif
+      to_float_from<uint32_t>( src, i, count, dst );
+    }
+
+    void f64_to_float( const unsigned char * src, size_t count, float * dst ) {
+      size_t i = 0;
+#ifdef TDMS_SSE2
+      for ( ; i + 4 <= count; i += 4 ) {
+        __m128 low = _mm_cvtpd_ps( _mm_loadu_pd( (const double *) ( src + i * 8 ) ) );
+        __m128 high = _mm_cvtpd_ps( _mm_loadu_pd( (const double *) ( src + i * 8 + 16 ) ) );
+        _mm_storeu_ps( dst + i, _mm_movelh_ps( low, high ) );
+      }
+#endif
+      to_float_from<double>( src, i, count, dst );
+    }
+
+    template<size_t W>
+    void gather_fixed( const unsigned char * src, size_t stride, size_t count, unsigned char * dst ) {
+      for ( size_t i = 0; i < count; ++i ) {
+        memcpy( dst + i * W, src + i * stride, W );
+      }
+    }
+  }
+
+  void deinterleave( const unsigned char * src, size_t rows, size_t cols,
+      size_t width, unsigned char * const * columns ) {
+    switch ( width ) {
+      case 1:
+        deinterleave_fixed<1>( src, rows, cols, columns );
+        break;
+      case 2:
+        deinterleave_fixed<2>( src, rows, cols, columns );
+        break;
+      case 4:
+        deinterleave_fixed<4>( src, rows, cols, columns );
+        break;
+      case 8:
+        deinterleave_fixed<8>( src, rows, cols, columns );
+        break;
+      case 16:
+        deinterleave_fixed<16>( src, rows, cols, columns );
+        break;
+      default:
+        for ( size_t c = 0; c < cols; ++c ) {
+          gather( src + c * width, cols * width, width, rows, columns[c] );
+        }
+        break;
+    }
+  }
+
+  void gather( const unsigned char * src, size_t stride, size_t width,
+      size_t count, unsigned char * dst ) {
+    switch ( width ) {
+      case 1:
+        gather_fixed<1>( src, stride, count, dst );
+        break;
+      case 2:
+        gather_fixed<2>( src, stride, count, dst );
+        break;
+      case 4:
+        gather_fixed<4>( src, stride, count, dst );
+        break;
+      case 8:
+        gather_fixed<8>( src, stride, count, dst );
+        break;
+      case 16:
+        gather_fixed<16>( src, stride, count, dst );
+        break;
+      default:
+        for ( size_t i = 0; i < count; ++i ) {
+          memcpy( dst + i * width, src + i * stride, width );
+        }
+        break;
+    }
+  }
+
+  void byteswap( const unsigned char * src, size_t width, size_t count, unsigned char * dst ) {
+    switch ( width ) {
+      case 0:
+        break;
+      case 1:
+        if ( src != dst ) {
+          memcpy( dst, src, count );
+        }
+        break;
+      case 2:
+        byteswap_fixed<2>( src, count, dst );
+        break;
+      case 4:
+        byteswap_fixed<4>( src, count, dst );
+        break;
+      case 8:
+        byteswap_fixed<8>( src, count, dst );
+        break;
+      case 16:
+        byteswap_fixed<16>( src, count, dst );
+        break;
+      default:
+        if ( src != dst ) {
+          memcpy( dst, src, count * width );
+        }
+        for ( size_t i = 0; i < count; ++i ) {
+          for ( size_t b = 0; b < width / 2; ++b ) {
+            unsigned char tmp = dst[i * width + b];
+            dst[i * width + b] = dst[i * width + width - 1 - b];
+            dst[i * width + width - 1 - b] = tmp;
+          }
+        }
+        break;
+    }
+  }
+
+  void extended_to_double( const unsigned char * src, size_t count, double * dst ) {
+    for ( size_t i = 0; i < count; ++i, src += 16 ) {
+      // a 64-bit mantissa with an explicit integer bit, then the sign
+      // and a 15-bit exponent
+      uint64_t mantissa;
+      uint16_t sign_exponent;
+      memcpy( &mantissa, src, 8 );
+      memcpy( &sign_exponent, src + 8, 2 );
+      uint64_t sign = (uint64_t) ( sign_exponent >> 15 ) << 63;
+      int exponent = sign_exponent & 0x7FFF;
+      int biased = exponent - 16383 + 1023;
+
+      uint64_t bits;
+      if ( biased > 0 && biased < 0x7FF && ( mantissa >> 63 ) ) {
+        // a normal double: drop the integer bit, and round the other 63
+        // bits to 52, to nearest even (a carry into the exponent is right)
+        uint64_t fraction = ( mantissa << 1 ) >> 12;
+        uint64_t dropped = mantissa & 0x7FF;
+        bits = ( (uint64_t) biased << 52 ) | fraction;
+        if ( dropped > 0x400 || ( 0x400 == dropped && ( fraction & 1 ) ) ) {
+          ++bits;
+        }
+        bits |= sign;
+      }
+      else {
+        // zeros, infinities, NaNs, and values out of a double's normal
+        // range. shift is the power of two the mantissa is scaled by, in
+        // units of the smallest subnormal double.
+        int shift = ( 0 == exponent ? 1 : exponent ) - 16383 - 63 + 1074;
+        if ( 0x7FFF == exponent ) {
+          double value = ( 0 == ( mantissa << 1 ) ? HUGE_VAL : std::nan( "" ) );
+          memcpy( &bits, &value, 8 );
+        }
+        else if ( shift >= 0 || ( shift > -64 && ( mantissa >> -shift ) >= ( (uint64_t) 1 << 52 ) ) ) {
+          // the result is normal (or exact), so the scaling is exact and
+          // this only rounds once
+          double value = std::ldexp( (double) mantissa, shift - 1074 );
+          memcpy( &bits, &value, 8 );
+        }
+        else if ( shift < -64 ) {
+          bits = 0;
+        }
+        else {
+          // subnormal: round to a whole number of the smallest subnormal
+          // (a carry makes the smallest normal double, which is right)
+          uint64_t whole = ( -64 == shift ? 0 : mantissa >> -shift );
+          uint64_t dropped = ( -64 == shift ? mantissa : mantissa << ( 64 + shift ) );
+          const uint64_t half = (uint64_t) 1 << 63;
+          bits = whole;
+          if ( dropped > half || ( half == dropped && ( whole & 1 ) ) ) {
+            ++bits;
+          }
+        }
+        bits |= sign;
+      }
+      memcpy( dst + i, &bits, 8 );
+    }
+  }
+
+  namespace {
+    // TDMS times count from 1904, not 1970
+    const int64_t epoch_offset = 2082844800;
+    const uint64_t nanoseconds_per_second = 1000000000;
+  }
+
+  void timestamps_to_nanoseconds( const unsigned char * src, size_t count, int64_t * dst ) {
+    // the fraction is in units of 2^-64 s, so its nanoseconds are the top
+    // 64 bits of fraction * 10^9, which is worked out 32 bits at a time:
+    // (hi * 10^9 + (lo * 10^9 >> 32) + 2^31) >> 32, rounding to nearest
+    size_t i = 0;
+#ifdef TDMS_SSE2
+    const __m128i billion = _mm_set1_epi32( (int) nanoseconds_per_second );
+    const __m128i half = _mm_set1_epi64x( (int64_t) 1 << 31 );
+    const __m128i offset = _mm_set1_epi64x( (int64_t) ( epoch_offset * nanoseconds_per_second ) );
+    for ( ; i + 2 <= count; i += 2 ) {
+      __m128i t0 = _mm_loadu_si128( (const __m128i *) ( src + i * 16 ) );
+      __m128i t1 = _mm_loadu_si128( (const __m128i *) ( src + i * 16 + 16 ) );
+      __m128i fraction = _mm_unpacklo_epi64( t0, t1 );
+      __m128i seconds = _mm_unpackhi_epi64( t0, t1 );
+
+      __m128i lo = _mm_mul_epu32( fraction, billion );
+      __m128i hi = _mm_mul_epu32( _mm_srli_epi64( fraction, 32 ), billion );
+      __m128i ns = _mm_srli_epi64( _mm_add_epi64( _mm_add_epi64( hi, _mm_srli_epi64( lo, 32 ) ), half ), 32 );
+
+      // seconds * 10^9, modulo 2^64, which is right for negative seconds too
+      __m128i whole = _mm_add_epi64( _mm_mul_epu32( seconds, billion ),
+          _mm_slli_epi64( _mm_mul_epu32( _mm_srli_epi64( seconds, 32 ), billion ), 32 ) );
+      _mm_storeu_si128( (__m128i *) ( dst + i ), _mm_add_epi64( _mm_sub_epi64( whole, offset ), ns ) );
+    }
+#endif
+    for ( ; i < count; ++i ) {
+      uint64_t fraction;
+      int64_t seconds;
+      memcpy( &fraction, src + i * 16, 8 );
+      memcpy( &seconds, src + i * 16 + 8, 8 );
+      uint64_t lo = ( fraction & 0xFFFFFFFF ) * nanoseconds_per_second;
+      uint64_t hi = ( fraction >> 32 ) * nanoseconds_per_second;
+      uint64_t ns = ( hi + ( lo >> 32 ) + ( (uint64_t) 1 << 31 ) ) >> 32;
+      dst[i] = (int64_t) ( (uint64_t) seconds * nanoseconds_per_second
+          - (uint64_t) epoch_offset * nanoseconds_per_second + ns );
+    }
+  }
+
+  void timestamps_to_seconds( const unsigned char * src, size_t count, double * dst ) {
+    // the whole seconds, plus the fraction's top and bottom 32 bits, each
+    // of which converts exactly
+    size_t i = 0;
+#ifdef TDMS_SSE2
+    // adding 2^52 + 2^51 puts an integer of less than 2^51 in the
+    // mantissa of a double, so it converts with integer arithmetic
+    const __m128i magic = _mm_set1_epi64x( 0x4338000000000000 );
+    const __m128d magic_value = _mm_set1_pd( 6755399441055744.0 );
+    // and a 32-bit integer under 2^52
+    const __m128i exponent_52 = _mm_set1_epi64x( 0x4330000000000000 );
+    const __m128d two_52 = _mm_set1_pd( 4503599627370496.0 );
+    const __m128i low_32 = _mm_set1_epi64x( 0xFFFFFFFF );
+    const __m128i offset = _mm_set1_epi64x( epoch_offset );
+    const __m128d hi_scale = _mm_set1_pd( 0x1p-32 );
+    const __m128d lo_scale = _mm_set1_pd( 0x1p-64 );
+    for ( ; i + 2 <= count; i += 2 ) {
+      __m128i t0 = _mm_loadu_si128( (const __m128i *) ( src + i * 16 ) );
+      __m128i t1 = _mm_loadu_si128( (const __m128i *) ( src + i * 16 + 16 ) );
+      __m128i fraction = _mm_unpacklo_epi64( t0, t1 );
+      __m128i seconds = _mm_sub_epi64( _mm_unpackhi_epi64( t0, t1 ), offset );
+
+      __m128d whole = _mm_sub_pd( _mm_castsi128_pd( _mm_add_epi64( seconds, magic ) ), magic_value );
+      __m128d hi = _mm_sub_pd( _mm_castsi128_pd( _mm_or_si128( _mm_srli_epi64( fraction, 32 ), exponent_52 ) ), two_52 );
+      __m128d lo = _mm_sub_pd( _mm_castsi128_pd( _mm_or_si128( _mm_and_si128( fraction, low_32 ), exponent_52 ) ), two_52 );
+      __m128d part = _mm_add_pd( _mm_mul_pd( hi, hi_scale ), _mm_mul_pd( lo, lo_scale ) );
+      _mm_storeu_pd( dst + i, _mm_add_pd( whole, part ) );
+    }
+#endif
+    for ( ; i < count; ++i ) {
+      uint64_t fraction;
+      int64_t seconds;
+      memcpy( &fraction, src + i * 16, 8 );
+      memcpy( &seconds, src + i * 16 + 8, 8 );
+      double part = (double) ( fraction >> 32 ) * 0x1p-32 + (double) ( fraction & 0xFFFFFFFF ) * 0x1p-64;
+      dst[i] = (double) ( seconds - epoch_offset ) + part;
+    }
+  }
+
+  bool to_double( const unsigned char * src, tds_type_code tds_type, size_t count, double * dst ) {
+    switch ( tds_type ) {
+      case tdsTypeI8:
+        i8_to_double( src, count, dst );
+        break;
+      case tdsTypeI16:
+        i16_to_double( src, count, dst );
+        break;
+      case tdsTypeI32:
+        i32_to_double( src, count, dst );
+        break;
+      case tdsTypeI64:
+        to_double_from<int64_t>( src, 0, count, dst );
+        break;
+      case tdsTypeU8:
+        u8_to_double( src, count, dst );
+        break;
+      case tdsTypeU16:
+        u16_to_double( src, count, dst );
+        break;
+      case tdsTypeU32:
+        u32_to_double( src, count, dst );
+        break;
+      case tdsTypeU64:
+        to_double_from<uint64_t>( src, 0, count, dst );
+        break;
+      case tdsTypeSingleFloat:
+      case tdsTypeSingleFloatWithUnit:
+        f32_to_double( src, count, dst );
+        break;
+      case tdsTypeDoubleFloat:
+      case tdsTypeDoubleFloatWithUnit:
+        memmove( dst, src, count * sizeof ( double ) );
+        break;
+      case tdsTypeExtendedFloat:
+      case tdsTypeExtendedFloatWithUnit:
+        extended_to_double( src, count, dst );
+        break;
+      default:
+        return false;
+    }
+    return true;
+  }
+
+  bool to_float( const unsigned char * src, tds_type_code tds_type, size_t count, float * dst ) {
+    switch ( tds_type ) {
+      case tdsTypeI8:
+        i8_to_float( src, count, dst );
+        break;
+      case tdsTypeI16:
+        i16_to_float( src, count, dst );
+        break;
+      case tdsTypeI32:
+        i32_to_float( src, count, dst );
+        break;
+      case tdsTypeI64:
+        to_float_from<int64_t>( src, 0, count, dst );
+        break;
+      case tdsTypeU8:
+        u8_to_float( src, count, dst );
+        break;
+      case tdsTypeU16:
+        u16_to_float( src, count, dst );
+        break;
+      case tdsTypeU32:
+        u32_to_float( src, count, dst );
+        break;
+      case tdsTypeU64:
+        to_float_from<uint64_t>( src, 0, count, dst );
+        break;
+      case tdsTypeSingleFloat:
+      case tdsTypeSingleFloatWithUnit:
+        memmove( dst, src, count * sizeof ( float ) );
+        break;
+      case tdsTypeDoubleFloat:
+      case tdsTypeDoubleFloatWithUnit:
+        f64_to_float( src, count, dst );
+        break;
+      case tdsTypeExtendedFloat:
+      case tdsTypeExtendedFloatWithUnit:
+      {
+        // through double, a block at a time
+        double block[256];
+        for ( size_t i = 0; i < count; i += 256 ) {
+          size_t n = std::min<size_t>( 256, count - i );
+          extended_to_double( src + i * 16, n, block );
+          f64_to_float( (const unsigned char *) block, n, dst + i );
+        }
+        break;
+      }
+      default:
+        return false;
+    }
+    return true;
+  }
+
+  void polynomial( const double * src, size_t count, const double * coeffs,
+      size_t num_coeffs, double * dst ) {
+    if ( 0 == num_coeffs ) {
+      std::fill( dst, dst + count, 0.0 );
+      return;
+    }
+    // Horner's rule, from the highest power down
+    size_t i = 0;
+#ifdef TDMS_SSE2
+    for ( ; i + 4 <= count; i += 4 ) {
+      __m128d x0 = _mm_loadu_pd( src + i );
+      __m128d x1 = _mm_loadu_pd( src + i + 2 );
+      __m128d y0 = _mm_set1_pd( coeffs[num_coeffs - 1] );
+      __m128d y1 = y0;
+      for ( size_t k = num_coeffs - 1; k-- > 0; ) {
+        __m128d c = _mm_set1_pd( coeffs[k] );
+        y0 = _mm_add_pd( _mm_mul_pd( y0, x0 ), c );
+        y1 = _mm_add_pd( _mm_mul_pd( y1, x1 ), c );
+      }
+      _mm_storeu_pd( dst + i, y0 );
+      _mm_storeu_pd( dst + i + 2, y1 );
+    }
+#endif
+    for ( ; i < count; ++i ) {
+      double x = src[i];
+      double y = coeffs[num_coeffs - 1];
+      for ( size_t k = num_coeffs - 1; k-- > 0; ) {
+        y = y * x + coeffs[k];
+      }
+      dst[i] = y;
+    }
+  }
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#include "data_type.h"
+#include "tdms_exports.h"
+
+namespace TDMS {
+
+  /**
+   * Splits rows x cols elements of width bytes each (stored a row at a
+   * time, as interleaved data is) into one contiguous array per column:
+   * column c goes to columns[c], which needs room for rows elements.
+   * Widths of 1, 2, 4, 8 and 16 bytes use vectorized kernels where the
+   * processor has them; other widths are copied an element at a time.
+   */
+  TDMS_EXPORT void deinterleave( const unsigned char * src, size_t rows, size_t cols,
+      size_t width, unsigned char * const * columns );
+
+  /**
+   * Copies count elements of width bytes each, stride bytes apart in src,
+   * to the contiguous array dst.
+   */
+  TDMS_EXPORT void gather( const unsigned char * src, size_t stride, size_t width,
+      size_t count, unsigned char * dst );
+
+  /**
+   * Reverses the bytes of count elements of width bytes each, from src to
+   * dst (which may be the same array). Widths of 2, 4, 8 and 16 bytes use
+   * vectorized kernels where the processor has them.
+   */
+  TDMS_EXPORT void byteswap( const unsigned char * src, size_t width, size_t count,
+      unsigned char * dst );
+
+  /**
+   * Converts count 80-bit extended precision floats, each stored in the
+   * first 10 of 16 little-endian bytes, to doubles, rounding to nearest.
+   */
+  TDMS_EXPORT void extended_to_double( const unsigned char * src, size_t count, double * dst );
+
+  /**
+   * Converts count TDMS timestamps (16 little-endian bytes each) to
+   * nanoseconds since the Unix epoch, rounded to nearest. These cover
+   * the years 1678 to 2262; times outside those wrap around.
+   */
+  TDMS_EXPORT void timestamps_to_nanoseconds( const unsigned char * src, size_t count, int64_t * dst );
+
+  /**
+   * Converts count TDMS timestamps (16 little-endian bytes each) to
+   * seconds since the Unix epoch.
+   */
+  TDMS_EXPORT void timestamps_to_seconds( const unsigned char * src, size_t count, double * dst );
+
+  /**
+   * Converts count little-endian values of the numeric TDMS type
+   * tds_type (tdsTypeI8 to tdsTypeExtendedFloat, and the ones with
+   * units) to doubles. Returns false,
+   * without converting anything, for other types.
+   */
+  TDMS_EXPORT bool to_double( const unsigned char * src, tds_type_code tds_type, size_t count, double * dst );
+
+  /**
+   * Converts count little-endian values of the numeric TDMS type
+   * tds_type to floats, rounding to nearest. Extended floats are rounded
+   * to double first. Returns false, without converting anything, for
+   * other types.
+   */
+  TDMS_EXPORT bool to_float( const unsigned char * src, tds_type_code tds_type, size_t count, float * dst );
+
+  /**
+   * Evaluates the polynomial coeffs[0] + coeffs[1] x + coeffs[2] x^2 ...
+   * at each of count values, from src to dst (which may be the same array).
+   */
+  TDMS_EXPORT void polynomial( const double * src, size_t count, const double * coeffs,
+      size_t num_coeffs, double * dst );
+}
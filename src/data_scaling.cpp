@@ -0,0 +1,190 @@
+#include <cstring>
+#include <algorithm>
+
+#include "data_scaling.hpp"
+#include "data_kernels.hpp"
+#include "log.hpp"
+
+namespace TDMS {
+
+  namespace {
+
+    // the input source of a scale that takes the raw values
+    const double raw_input_source = 4294967295.0;
+
+    // values scaled at a time, so they're still in cache for the polynomial
+    const size_t block_size = 1024;
+
+    template<typename T>
+    double property_as( const channel::property& p ) {
+      T value;
+      memcpy( &value, p.value, sizeof ( T ) );
+      return (double) value;
+    }
+
+    bool numeric_value( const channel::property& p, double& value ) {
+      switch ( p.data_type.code( ) ) {
+        case tdsTypeDoubleFloat:
+        case tdsTypeDoubleFloatWithUnit:
+        case tdsTypeExtendedFloat:
+        case tdsTypeExtendedFloatWithUnit:
+          value = property_as<double>( p );
+          break;
+        case tdsTypeSingleFloat:
+        case tdsTypeSingleFloatWithUnit:
+          value = property_as<float>( p );
+          break;
+        case tdsTypeI8:
+          value = property_as<int8_t>( p );
+          break;
+        case tdsTypeI16:
+          value = property_as<int16_t>( p );
+          break;
+        case tdsTypeI32:
+          value = property_as<int32_t>( p );
+          break;
+        case tdsTypeI64:
+          value = property_as<int64_t>( p );
+          break;
+        case tdsTypeU8:
+          value = property_as<uint8_t>( p );
+          break;
+        case tdsTypeU16:
+          value = property_as<uint16_t>( p );
+          break;
+        case tdsTypeU32:
+          value = property_as<uint32_t>( p );
+          break;
+        case tdsTypeU64:
+          value = property_as<uint64_t>( p );
+          break;
+        default:
+          return false;
+      }
+      return true;
+    }
+
+    // outer(inner(x)), by Horner's rule on the polynomials themselves
+    std::vector<double> compose( const std::vector<double>& outer, const std::vector<double>& inner ) {
+      std::vector<double> result{ outer.empty( ) ? 0.0 : outer.back( ) };
+      for ( size_t k = outer.size( ) - 1; k-- > 0; ) {
+        std::vector<double> product( result.size( ) + inner.size( ) - 1, 0.0 );
+        for ( size_t i = 0; i < result.size( ); ++i ) {
+          for ( size_t j = 0; j < inner.size( ); ++j ) {
+            product[i + j] += result[i] * inner[j];
+          }
+        }
+        product[0] += outer[k];
+        result.swap( product );
+      }
+      return result;
+    }
+  }
+
+  std::shared_ptr<const scaling> scaling::from_properties(
+      const std::map<std::string, std::shared_ptr<channel::property>>& properties ) {
+    auto find = [&properties]( const std::string& name ) -> const channel::property * {
+      auto it = properties.find( name );
+      return ( it == properties.end( ) ? nullptr : it->second.get( ) );
+    };
+    auto number = [&find]( const std::string& name, double& value ) {
+      const channel::property * p = find( name );
+      return ( nullptr != p && numeric_value( *p, value ) );
+    };
+
+    const channel::property * status = find( "NI_Scaling_Status" );
+    if ( nullptr != status && status->data_type.is_string( ) && "scaled" == status->asString( ) ) {
+      return nullptr;
+    }
+    double num_scales;
+    if ( !number( "NI_Number_Of_Scales", num_scales ) || num_scales < 1 ) {
+      return nullptr;
+    }
+
+    // follow the input sources back from the last scale to the raw values
+    auto result = std::make_shared<scaling>( );
+    std::vector<std::vector<double>> chain;
+    double index = num_scales - 1;
+    while ( true ) {
+      if ( chain.size( ) >= num_scales || index < 0 || index >= num_scales ) {
+        log::debug( ) << "Scales don't lead back to the raw data" << std::endl;
+        return nullptr;
+      }
+      std::string prefix = "NI_Scale[" + std::to_string( (uint32_t) index ) + "]_";
+      const channel::property * type = find( prefix + "Scale_Type" );
+      if ( nullptr == type || !type->data_type.is_string( ) ) {
+        return nullptr;
+      }
+
+      std::vector<double> coefficients;
+      std::string input;
+      if ( "Linear" == type->asString( ) ) {
+        double slope, intercept;
+        if ( !number( prefix + "Linear_Slope", slope ) || !number( prefix + "Linear_Y_Intercept", intercept ) ) {
+          return nullptr;
+        }
+        coefficients = { intercept, slope };
+        input = prefix + "Linear_Input_Source";
+      }
+      else if ( "Polynomial" == type->asString( ) ) {
+        // each coefficient is a property of its own, so a size bigger
+        // than the number of properties is bogus
+        double size;
+        if ( !number( prefix + "Polynomial_Coefficients_Size", size ) || size < 0
+            || size > properties.size( ) ) {
+          return nullptr;
+        }
+        coefficients.resize( (size_t) size );
+        for ( size_t k = 0; k < coefficients.size( ); ++k ) {
+          if ( !number( prefix + "Polynomial_Coefficients[" + std::to_string( k ) + "]", coefficients[k] ) ) {
+            return nullptr;
+          }
+        }
+        if ( coefficients.empty( ) ) {
+          coefficients.push_back( 0.0 );
+        }
+        input = prefix + "Polynomial_Input_Source";
+      }
+      else {
+        log::debug( ) << "Scale type " << type->asString( ) << " is not supported" << std::endl;
+        return nullptr;
+      }
+      chain.push_back( coefficients );
+
+      double source;
+      if ( !number( input, source ) || source < 0 || source >= raw_input_source ) {
+        result->raw_scale = (uint32_t) index;
+        break;
+      }
+      index = source;
+    }
+
+    result->coefficients = chain.back( );
+    for ( size_t i = chain.size( ) - 1; i-- > 0; ) {
+      result->coefficients = compose( chain[i], result->coefficients );
+    }
+    return result;
+  }
+
+  void scaling::apply( const unsigned char * raw, tds_type_code tds_type, size_t count, double * out ) const {
+    size_t width = data_type_t::from_code( tds_type ).length( );
+    for ( size_t i = 0; i < count; i += block_size ) {
+      size_t n = std::min( block_size, count - i );
+      if ( !to_double( raw + i * width, tds_type, n, out + i ) ) {
+        throw std::runtime_error( "Can't scale values of type "
+            + data_type_t::from_code( tds_type ).name( ) );
+      }
+      polynomial( out + i, n, coefficients.data( ), coefficients.size( ), out + i );
+    }
+  }
+
+  void scaling::apply( const unsigned char * raw, tds_type_code tds_type, size_t count, float * out ) const {
+    size_t width = data_type_t::from_code( tds_type ).length( );
+    double scaled[block_size];
+    for ( size_t i = 0; i < count; i += block_size ) {
+      size_t n = std::min( block_size, count - i );
+      apply( raw + i * width, tds_type, n, scaled );
+      to_float( (const unsigned char *) scaled, tdsTypeDoubleFloat, n, out + i );
+    }
+  }
+}
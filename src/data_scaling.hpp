@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "tdms_exports.h"
+#include "tdms_channel.h"
+
+namespace TDMS {
+
+  /**
+   * How a channel's raw values become engineering units, as described by
+   * its NI_Scale[n]_* properties. A chain of linear and polynomial scales
+   * is folded into a single polynomial, so the values are scaled in one
+   * pass however long the chain is.
+   */
+  struct scaling {
+    // the scale the raw values go into (DAQmx channels pick the scaler
+    // to read by this)
+    uint32_t raw_scale = 0;
+    // coefficients[k] multiplies x^k
+    std::vector<double> coefficients;
+
+    /**
+     * The scaling the properties describe, or nullptr when there is none,
+     * the values are already scaled, or it uses scales other than linear
+     * and polynomial ones.
+     */
+    TDMS_EXPORT static std::shared_ptr<const scaling> from_properties(
+        const std::map<std::string, std::shared_ptr<channel::property>>& properties );
+
+    /**
+     * Converts count little-endian values of the numeric TDMS type
+     * tds_type to doubles and scales them.
+     */
+    TDMS_EXPORT void apply( const unsigned char * raw, tds_type_code tds_type, size_t count, double * out ) const;
+
+    /**
+     * The same, rounding the scaled values to floats
+     */
+    TDMS_EXPORT void apply( const unsigned char * raw, tds_type_code tds_type, size_t count, float * out ) const;
+  };
+}
@@ -8,104 +8,176 @@
 
 #include "log.hpp"
 #include "data_extraction.hpp"
+#include "data_kernels.hpp"
 #include <cstring> // memcpy
+#include <cstdlib>
+#include <stdexcept>
+#include <type_traits>
 
 namespace TDMS{
 
-  data_type_t::data_type_t( const data_type_t& dt ) :
-      _name( dt._name ),
-      _length( dt._length ),
-      _ctype_length( dt._ctype_length ),
-      read_to( dt.read_to ),
-      read_array_to( dt.read_array_to ) { }
+  namespace {
 
-  data_type_t::data_type_t( ) :
-      _name( "INVALID TYPE" ),
-      _length( 0 ),
-      _ctype_length( 0 ) {
-    _init_default_array_reader( );
-  }
-
-  data_type_t::data_type_t( const std::string& _n, const size_t _len,
-      std::function<void (const unsigned char*, void*) > reader ) :
-      _name( _n ),
-      _length( _len ),
-      _ctype_length( _len ),
-      read_to( reader ) {
-    _init_default_array_reader( );
-  }
+    // assembled as unsigned, so the top byte doesn't shift into the sign
+    template<typename T>
+    void read_le_value( const unsigned char* data, void* target ) {
+      *( (T*) target ) = (T) read_le<typename std::make_unsigned<T>::type>( data );
+    }
 
-  data_type_t::data_type_t( const std::string& _n, const size_t _len,
-      std::function<void (const unsigned char*, void*) > reader,
-      std::function<void (const unsigned char*, void*, size_t ) > array_reader ) :
-      _name( _n ),
-      _length( _len ),
-      _ctype_length( _len ),
-      read_to( reader ),
-      read_array_to( array_reader ) { }
+    // values that are stored as they decode
+    template<typename T>
+    void copy_array( const unsigned char* data, void* target, size_t number_values ) {
+      memcpy( target, data, number_values * sizeof (T ) );
+    }
 
-  data_type_t::data_type_t( const std::string& _n, const size_t _len, const size_t _ctype_len,
-      std::function<void (const unsigned char*, void*) > reader ) :
-      _name( _n ),
-      _length( _len ),
-      _ctype_length( _ctype_len ),
-      read_to( reader ) {
-    _init_default_array_reader( );
+    [[noreturn]] void not_implemented( data_type_t type ) {
+      throw std::runtime_error{"Reading " + type.name( ) + " is not implemented. Aborting" };
+    }
   }
 
-  void data_type_t::_init_default_array_reader( ) {
-    auto read = this->read_to;
-    auto ctype = this->ctype_length( );
-    read_array_to = [read, ctype](const unsigned char* source, void* target, size_t number_values ) {
-      log::debug( ) << "Doing iterative reading" << std::endl;
-      for ( size_t i = 0; i < number_values; ++i ) {
-        read( source + ( i * ctype ), (void*) ( ( (char*) target ) + ( i * ctype ) ) );
-      }
-    };
+  data_type_t data_type_t::from_code( uint32_t code ) {
+    switch ( code ) {
+      case tdsTypeVoid:
+      case tdsTypeI8:
+      case tdsTypeI16:
+      case tdsTypeI32:
+      case tdsTypeI64:
+      case tdsTypeU8:
+      case tdsTypeU16:
+      case tdsTypeU32:
+      case tdsTypeU64:
+      case tdsTypeSingleFloat:
+      case tdsTypeDoubleFloat:
+      case tdsTypeExtendedFloat:
+      case tdsTypeDoubleFloatWithUnit:
+      case tdsTypeExtendedFloatWithUnit:
+      case tdsTypeSingleFloatWithUnit:
+      case tdsTypeString:
+      case tdsTypeBoolean:
+      case tdsTypeTimeStamp:
+      case tdsTypeDAQmxRawData:
+        return data_type_t( (tds_type_code) code );
+      default:
+        throw std::out_of_range( "Unknown data type " + std::to_string( code ) );
+    }
   }
 
-  template<typename T>
-  inline std::function<void (const unsigned char*, void*) > put_on_heap_generator( std::function<T( const unsigned char* )> f ) {
-    return [f](const unsigned char* data, void* ptr ) {
-      *( (T*) ptr ) = f( data );
+  const std::string& data_type_t::name( ) const {
+    static const std::string names[] = {
+      "tdsTypeVoid", "tdsTypeI8", "tdsTypeI16", "tdsTypeI32", "tdsTypeI64",
+      "tdsTypeU8", "tdsTypeU16", "tdsTypeU32", "tdsTypeU64",
+      "tdsTypeSingleFloat", "tdsTypeDoubleFloat", "tdsTypeExtendedFloat",
+      "tdsTypeDoubleFloatWithUnit", "tdsTypeExtendedFloatWithUnit",
+      "tdsTypeSingleFloatWithUnit", "tdsTypeString", "tdsTypeBoolean",
+      "tdsTypeTimeStamp", "tdsTypeDAQmxRawData", "INVALID TYPE"
     };
+    switch ( _code ) {
+      case tdsTypeSingleFloatWithUnit:
+        return names[14];
+      case tdsTypeString:
+        return names[15];
+      case tdsTypeBoolean:
+        return names[16];
+      case tdsTypeTimeStamp:
+        return names[17];
+      case tdsTypeDAQmxRawData:
+        return names[18];
+      case tdsTypeInvalid:
+        return names[19];
+      default:
+        return ( _code <= tdsTypeExtendedFloatWithUnit ? names[_code] : names[19] );
+    }
   }
 
-  template<typename T>
-  inline std::function<void (const unsigned char*, void*) > put_le_on_heap_generator( ) {
-    return put_on_heap_generator<T>( &read_le<T> );
+  void* data_type_t::read( const unsigned char* data ) const {
+    void* d = malloc( ctype_length( ) );
+    try {
+      switch ( _code ) {
+        case tdsTypeI8:
+          read_le_value<int8_t>( data, d );
+          break;
+        case tdsTypeI16:
+          read_le_value<int16_t>( data, d );
+          break;
+        case tdsTypeI32:
+          read_le_value<int32_t>( data, d );
+          break;
+        case tdsTypeI64:
+          read_le_value<int64_t>( data, d );
+          break;
+        case tdsTypeU8:
+          read_le_value<uint8_t>( data, d );
+          break;
+        case tdsTypeU16:
+          read_le_value<uint16_t>( data, d );
+          break;
+        case tdsTypeU32:
+          read_le_value<uint32_t>( data, d );
+          break;
+        case tdsTypeU64:
+          read_le_value<uint64_t>( data, d );
+          break;
+        case tdsTypeSingleFloat:
+        case tdsTypeSingleFloatWithUnit:
+          *( (float*) d ) = read_le_float( data );
+          break;
+        case tdsTypeDoubleFloat:
+        case tdsTypeDoubleFloatWithUnit:
+          *( (double*) d ) = read_le_double( data );
+          break;
+        case tdsTypeExtendedFloat:
+        case tdsTypeExtendedFloatWithUnit:
+          *( (double*) d ) = read_le_extended( data );
+          break;
+        case tdsTypeTimeStamp:
+          *( (timestamp*) d ) = read_le_timestamp( data );
+          break;
+        default:
+          not_implemented( *this );
+      }
+    }
+    catch ( ... ) {
+      free( d );
+      throw;
+    }
+    return d;
   }
 
-  template<typename T>
-  inline std::function<void (const unsigned char*, void*, size_t ) > copy_array_reader_generator( ) {
-    return [](const unsigned char* source, void* tgt, size_t number_values ) {
-      memcpy( tgt, source, number_values * sizeof (T ) );
-    };
+  void data_type_t::read_array( const unsigned char* data, void* target, size_t number_values ) const {
+    switch ( _code ) {
+      case tdsTypeI8:
+      case tdsTypeU8:
+        copy_array<uint8_t>( data, target, number_values );
+        break;
+      case tdsTypeI16:
+      case tdsTypeU16:
+        copy_array<uint16_t>( data, target, number_values );
+        break;
+      case tdsTypeI32:
+      case tdsTypeU32:
+        copy_array<uint32_t>( data, target, number_values );
+        break;
+      case tdsTypeI64:
+      case tdsTypeU64:
+        copy_array<uint64_t>( data, target, number_values );
+        break;
+      case tdsTypeSingleFloat:
+      case tdsTypeSingleFloatWithUnit:
+        copy_array<float>( data, target, number_values );
+        break;
+      case tdsTypeDoubleFloat:
+      case tdsTypeDoubleFloatWithUnit:
+        copy_array<double>( data, target, number_values );
+        break;
+      case tdsTypeExtendedFloat:
+      case tdsTypeExtendedFloatWithUnit:
+        extended_to_double( data, number_values, (double*) target );
+        break;
+      case tdsTypeTimeStamp:
+        copy_array<timestamp>( data, target, number_values );
+        break;
+      default:
+        not_implemented( *this );
+    }
   }
-
-  std::function<void (const unsigned char*, void*) > not_implemented = [](const unsigned char*, void*) {
-    throw std::runtime_error{"Reading this type is not implemented. Aborting" };
-  };
-
-  const std::map<uint32_t, const data_type_t> data_type_t::_tds_datatypes = {
-    { 0, data_type_t( "tdsTypeVoid", 0, not_implemented ) },
-    { 1, data_type_t( "tdsTypeI8", 1, put_le_on_heap_generator<int8_t>( ), copy_array_reader_generator<int8_t>( ) ) },
-    { 2, data_type_t( "tdsTypeI16", 2, put_le_on_heap_generator<int16_t>( ) ) },
-    { 3, data_type_t( "tdsTypeI32", 4, put_le_on_heap_generator<int32_t>( ) ) },
-    { 4, data_type_t( "tdsTypeI64", 8, put_le_on_heap_generator<int32_t>( ) ) },
-    { 5, data_type_t( "tdsTypeU8", 1, put_le_on_heap_generator<uint8_t>( ) ) },
-    { 6, data_type_t( "tdsTypeU16", 2, put_le_on_heap_generator<uint16_t>( ) ) },
-    { 7, data_type_t( "tdsTypeU32", 4, put_le_on_heap_generator<uint32_t>( ) ) },
-    { 8, data_type_t( "tdsTypeU64", 8, put_le_on_heap_generator<uint64_t>( ) ) },
-    { 9, data_type_t( "tdsTypeSingleFloat", 4, put_on_heap_generator<float>( &read_le_float ), copy_array_reader_generator<float>( ) ) },
-    { 10, data_type_t( "tdsTypeDoubleFloat", 8, put_on_heap_generator<double>( &read_le_double ), copy_array_reader_generator<double>( ) ) },
-    { 11, data_type_t( "tdsTypeExtendedFloat", 0, not_implemented ) },
-    { 12, data_type_t( "tdsTypeDoubleFloatWithUnit", 8, not_implemented ) },
-    { 13, data_type_t( "tdsTypeExtendedFloatWithUnit", 0, not_implemented ) },
-    { 0x19, data_type_t( "tdsTypeSingleFloatWithUnit", 4, not_implemented ) },
-    { 0x20, data_type_t( "tdsTypeString", 0, not_implemented ) },
-    { 0x21, data_type_t( "tdsTypeBoolean", 1, not_implemented ) },
-    { 0x44, data_type_t( "tdsTypeTimeStamp", 16, put_on_heap_generator<time_t>( &read_timestamp ) ) },
-    { 0xFFFFFFFF, data_type_t( "tdsTypeDAQmxRawData", 0, not_implemented ) }
-  };
-}
\ No newline at end of file
+}
@@ -15,73 +15,161 @@
 #define DATA_TYPE_H
 
 #include "tdms_exports.h"
-#include <functional>
-#include <map>
+#include "data_extraction.hpp"
+#include <string>
+#include <cstddef>
+#include <cstdint>
 
 namespace TDMS {
 
-  class data_type_t {
-  public:
-    typedef std::function<void* ( ) > parse_t;
+  /**
+   * The TDMS type codes, as they are stored in files
+   */
+  enum tds_type_code : uint32_t {
+    tdsTypeVoid = 0,
+    tdsTypeI8 = 1,
+    tdsTypeI16 = 2,
+    tdsTypeI32 = 3,
+    tdsTypeI64 = 4,
+    tdsTypeU8 = 5,
+    tdsTypeU16 = 6,
+    tdsTypeU32 = 7,
+    tdsTypeU64 = 8,
+    tdsTypeSingleFloat = 9,
+    tdsTypeDoubleFloat = 10,
+    tdsTypeExtendedFloat = 11,
+    tdsTypeDoubleFloatWithUnit = 12,
+    tdsTypeExtendedFloatWithUnit = 13,
+    tdsTypeSingleFloatWithUnit = 0x19,
+    tdsTypeString = 0x20,
+    tdsTypeBoolean = 0x21,
+    tdsTypeTimeStamp = 0x44,
+    tdsTypeDAQmxRawData = 0xFFFFFFFF,
+    // not a TDMS type: what a data_type_t is before it's known
+    tdsTypeInvalid = 0xFFFFFFFE
+  };
 
-    TDMS_EXPORT data_type_t( );
+  /**
+   * The sizes of a type's values: length as they are stored (0 if that
+   * varies), ctype_length as they are decoded
+   */
+  struct tds_type_traits {
+    size_t length;
+    size_t ctype_length;
+  };
 
-    TDMS_EXPORT data_type_t( const data_type_t& dt );
+  constexpr tds_type_traits type_traits( tds_type_code code ) {
+    switch ( code ) {
+      case tdsTypeI8:
+      case tdsTypeU8:
+      case tdsTypeBoolean:
+        return { 1, 1 };
+      case tdsTypeI16:
+      case tdsTypeU16:
+        return { 2, 2 };
+      case tdsTypeI32:
+      case tdsTypeU32:
+      case tdsTypeSingleFloat:
+      case tdsTypeSingleFloatWithUnit:
+        return { 4, 4 };
+      case tdsTypeI64:
+      case tdsTypeU64:
+      case tdsTypeDoubleFloat:
+      case tdsTypeDoubleFloatWithUnit:
+        return { 8, 8 };
+      case tdsTypeExtendedFloat:
+      case tdsTypeExtendedFloatWithUnit:
+        // decoded to double
+        return { 16, 8 };
+      case tdsTypeTimeStamp:
+        return { 16, sizeof ( timestamp ) };
+      default:
+        return { 0, 0 };
+    }
+  }
 
-    TDMS_EXPORT data_type_t( const std::string& _name, const size_t _len,
-        std::function<void (const unsigned char*, void*) > reader );
+  /**
+   * A TDMS data type. It is nothing but the type's code, so is cheap to
+   * copy and compare; decoding dispatches on the code to kernels
+   * instantiated for each type.
+   */
+  class data_type_t {
+  public:
 
-    TDMS_EXPORT data_type_t( const std::string& _name,
-        const size_t _len,
-        std::function<void (const unsigned char*, void*) > reader,
-        std::function<void (const unsigned char*, void*, size_t ) > array_reader );
+    constexpr data_type_t( ) : _code( tdsTypeInvalid ) { }
 
-    TDMS_EXPORT data_type_t( const std::string& _name, const size_t _len, const size_t _ctype_len,
-        std::function<void (const unsigned char*, void*) > reader );
+    constexpr data_type_t( tds_type_code code ) : _code( code ) { }
 
-    TDMS_EXPORT bool is_valid( ) const {
-      return (_name != "INVALID TYPE" );
+    /**
+     * The type with the code read from a file; throws std::out_of_range
+     * for codes that aren't TDMS types
+     */
+    TDMS_EXPORT static data_type_t from_code( uint32_t code );
+
+    TDMS_EXPORT constexpr bool is_valid( ) const {
+      return ( tdsTypeInvalid != _code );
     }
 
-    TDMS_EXPORT bool operator==(const data_type_t& dt ) const {
-      return (_name == dt._name );
+    TDMS_EXPORT constexpr bool operator==(const data_type_t& dt ) const {
+      return ( _code == dt._code );
     }
 
-    TDMS_EXPORT bool operator!=(const data_type_t& dt ) const {
+    TDMS_EXPORT constexpr bool operator!=(const data_type_t& dt ) const {
       return !( *this == dt );
     }
 
-    TDMS_EXPORT void* read( const unsigned char* data ) {
-      void* d = malloc( _ctype_length );
-      read_to( data, d );
-      return d;
-    }
+    /**
+     * Decodes a single value, as it is stored (little-endian), into a
+     * malloc'ed value of its C type
+     */
+    TDMS_EXPORT void* read( const unsigned char* data ) const;
+
+    /**
+     * Decodes number_values values of this type, as they are stored
+     * (length() bytes each), to their C type (ctype_length() bytes each).
+     */
+    TDMS_EXPORT void read_array( const unsigned char* data, void* target, size_t number_values ) const;
 
-    TDMS_EXPORT static const std::map<uint32_t, const data_type_t> _tds_datatypes;
+    TDMS_EXPORT const std::string& name( ) const;
 
-    TDMS_EXPORT const std::string& name( ) const {
-      return _name;
+    TDMS_EXPORT constexpr uint32_t code( ) const {
+      return _code;
     }
 
-    TDMS_EXPORT size_t length( ) const {
-      return _length;
+    TDMS_EXPORT constexpr size_t length( ) const {
+      return type_traits( _code ).length;
     }
 
-    TDMS_EXPORT size_t ctype_length( ) const {
-      return _ctype_length;
+    TDMS_EXPORT constexpr size_t ctype_length( ) const {
+      return type_traits( _code ).ctype_length;
     }
 
-    TDMS_EXPORT bool is_string( ) const {
-      return ( "tdsTypeString" == _name );
+    TDMS_EXPORT constexpr bool is_string( ) const {
+      return ( tdsTypeString == _code );
+    }
+
+    TDMS_EXPORT constexpr bool is_daqmx( ) const {
+      return ( tdsTypeDAQmxRawData == _code );
     }
   private:
-    std::string _name;
-    size_t _length;
-    size_t _ctype_length;
-    void _init_default_array_reader( );
-    std::function<void (const unsigned char*, void*) > read_to;
-    std::function<void (const unsigned char*, void*, size_t ) > read_array_to;
+    tds_type_code _code;
   };
+
+  /**
+   * The code of the TDMS type whose values decode to the C type T
+   */
+  template<typename T> struct tds_type;
+  template<> struct tds_type<int8_t> { static constexpr tds_type_code code = tdsTypeI8; };
+  template<> struct tds_type<int16_t> { static constexpr tds_type_code code = tdsTypeI16; };
+  template<> struct tds_type<int32_t> { static constexpr tds_type_code code = tdsTypeI32; };
+  template<> struct tds_type<int64_t> { static constexpr tds_type_code code = tdsTypeI64; };
+  template<> struct tds_type<uint8_t> { static constexpr tds_type_code code = tdsTypeU8; };
+  template<> struct tds_type<uint16_t> { static constexpr tds_type_code code = tdsTypeU16; };
+  template<> struct tds_type<uint32_t> { static constexpr tds_type_code code = tdsTypeU32; };
+  template<> struct tds_type<uint64_t> { static constexpr tds_type_code code = tdsTypeU64; };
+  template<> struct tds_type<float> { static constexpr tds_type_code code = tdsTypeSingleFloat; };
+  template<> struct tds_type<double> { static constexpr tds_type_code code = tdsTypeDoubleFloat; };
+  template<> struct tds_type<timestamp> { static constexpr tds_type_code code = tdsTypeTimeStamp; };
 }
 #endif /* DATA_TYPE_H */
 
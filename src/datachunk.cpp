@@ -8,14 +8,113 @@
 #include "tdms_channel.h"
 #include "log.hpp"
 #include "data_extraction.hpp"
+#include "data_kernels.hpp"
+#include "data_scaling.hpp"
 
 
 namespace TDMS{
 
-  size_t datachunk::_read_values( const unsigned char*& data, endianness, listener * earful ) {
+  namespace {
+
+    // raw_data_index values of DAQmx objects, in place of a length. Files
+    // hold the bytes 69 12 00 00 and 6A 12 00 00, which read as 0x1269
+    // and 0x126A. NI's documentation gives the values as 0x69120000 and
+    // 0x69130000, as NI writes them, so those are accepted too.
+    const uint32_t format_changing_scaler = 0x00001269;
+    const uint32_t digital_line_scaler = 0x0000126A;
+    const uint32_t documented_format_changing_scaler = 0x69120000;
+    const uint32_t documented_digital_line_scaler = 0x69130000;
+
+    bool is_daqmx( uint32_t raw_data_index ) {
+      switch ( raw_data_index ) {
+        case format_changing_scaler:
+        case digital_line_scaler:
+        case documented_format_changing_scaler:
+        case documented_digital_line_scaler:
+          return true;
+        default:
+          return false;
+      }
+    }
+
+    // the TDMS types of the DAQmx raw data types, by their codes
+    const tds_type_code daqmx_types[] = {
+      tdsTypeU8, tdsTypeI8, tdsTypeU16, tdsTypeI16, tdsTypeU32,
+      tdsTypeI32, tdsTypeU64, tdsTypeI64, tdsTypeSingleFloat, tdsTypeDoubleFloat
+    };
+
+    const unsigned char* decode_daqmx( const unsigned char* data, uint32_t raw_data_index,
+        endianness e, daqmx_metadata& daqmx ) {
+      bool digital = ( digital_line_scaler == raw_data_index
+          || documented_digital_line_scaler == raw_data_index );
+      daqmx.scalers.resize( read_as<uint32_t>( data, e ) );
+      data += 4;
+      for ( auto& scaler : daqmx.scalers ) {
+        // the type, the raw buffer, the offset into its rows, a one-byte
+        // sample format bitmap and the scale ID
+        uint32_t type = read_as<uint32_t>( data, e );
+        if ( type >= sizeof ( daqmx_types ) / sizeof ( daqmx_types[0] ) ) {
+          throw std::runtime_error( "Unsupported DAQmx data type " + std::to_string( type ) );
+        }
+        scaler.data_type = daqmx_types[type];
+        scaler.buffer = read_as<uint32_t>( data + 4, e );
+        uint32_t offset = read_as<uint32_t>( data + 8, e );
+        if ( digital ) {
+          // digital lines' offsets are in bits
+          scaler.byte_offset = offset / 8;
+          scaler.bit = offset % 8;
+        }
+        else {
+          scaler.byte_offset = offset;
+          scaler.bit = -1;
+        }
+        scaler.scale_id = read_as<uint32_t>( data + 13, e );
+        data += 17;
+      }
+
+      daqmx.widths.resize( read_as<uint32_t>( data, e ) );
+      data += 4;
+      for ( auto& width : daqmx.widths ) {
+        width = read_as<uint32_t>( data, e );
+        data += 4;
+      }
+
+      for ( const auto& scaler : daqmx.scalers ) {
+        size_t length = ( scaler.bit >= 0 ? 1 : data_type_t::from_code( scaler.data_type ).length( ) );
+        if ( scaler.buffer >= daqmx.widths.size( )
+            || scaler.byte_offset + length > daqmx.widths[scaler.buffer] ) {
+          throw std::runtime_error( "DAQmx scaler is outside its raw data buffer" );
+        }
+      }
+      return data;
+    }
+  }
+
+  size_t datachunk::_read_values( const unsigned char*& data, endianness, listener * earful,
+      std::vector<std::string_view>& strings ) const {
     if ( _data_type.is_string( ) ) {
-      throw std::runtime_error( "Reading string data not yet implemented" );
-      // TODO ^
+      // a table of where each string ends, then all the strings
+      uint64_t table_size = _number_values * 4;
+      if ( table_size > _data_size ) {
+        throw std::runtime_error( "String data is too short for its offset table" );
+      }
+      const char * chars = (const char *) data + table_size;
+      uint64_t chars_size = _data_size - table_size;
+
+      strings.resize( _number_values );
+      uint32_t start = 0;
+      for ( size_t i = 0; i < _number_values; ++i ) {
+        uint32_t end = read_le<uint32_t>( data + i * 4 );
+        if ( end < start || end > chars_size ) {
+          throw std::runtime_error( "Bad string offset in " + _tdms_channel->_path );
+        }
+        strings[i] = std::string_view( chars + start, end - start );
+        start = end;
+      }
+      if ( earful ) {
+        earful->string_data( _tdms_channel->_path, strings.data( ), _number_values );
+      }
+      return _data_size;
     }
 
     //unsigned char* read_data = ()(_tdms_object->_data_start + _tdms_object->_data_insert_position);
@@ -29,7 +128,38 @@ namespace TDMS{
       earful->data( _tdms_channel->_path, data, _data_type, _number_values );
     }
 
-    return _number_values * _data_type.ctype_length( );
+    return _data_size;
+  }
+
+  bool datachunk::_same_layout( const datachunk& other ) const {
+    if ( _tdms_channel != other._tdms_channel || _has_data != other._has_data
+        || _number_values != other._number_values || _data_size != other._data_size
+        || _dimension != other._dimension || _data_type != other._data_type ) {
+      return false;
+    }
+    // DAQmx layouts and scalings are decoded afresh for every segment
+    // that lists the channel, so compare what they hold
+    if ( ( nullptr == _daqmx ) != ( nullptr == other._daqmx )
+        || ( nullptr == _scaling ) != ( nullptr == other._scaling ) ) {
+      return false;
+    }
+    if ( _daqmx && _daqmx != other._daqmx ) {
+      if ( _daqmx->widths != other._daqmx->widths
+          || _daqmx->scalers.size( ) != other._daqmx->scalers.size( ) ) {
+        return false;
+      }
+      for ( size_t i = 0; i < _daqmx->scalers.size( ); ++i ) {
+        const daqmx_scaler& a = _daqmx->scalers[i];
+        const daqmx_scaler& b = other._daqmx->scalers[i];
+        if ( a.data_type != b.data_type || a.buffer != b.buffer || a.byte_offset != b.byte_offset
+            || a.bit != b.bit || a.scale_id != b.scale_id ) {
+          return false;
+        }
+      }
+    }
+    return ( !_scaling || _scaling == other._scaling
+        || ( _scaling->raw_scale == other._scaling->raw_scale
+        && _scaling->coefficients == other._scaling->coefficients ) );
   }
 
   datachunk::datachunk( channel * o ) :
@@ -38,101 +168,124 @@ namespace TDMS{
       _data_size( 0 ),
       _has_data( nullptr != o ),
       _dimension( 1 ),
-      _data_type( data_type_t::_tds_datatypes.at( 0 ) ) { }
-
-  datachunk::datachunk( const datachunk& orig ) :
-      _tdms_channel( orig._tdms_channel ),
-      _number_values( orig._number_values ),
-      _data_size( orig._data_size ),
-      _has_data( orig._has_data ),
-      _dimension( orig._dimension ),
-      _data_type( orig._data_type ) { }
-
-  const unsigned char* datachunk::_parse_metadata( const unsigned char* data ) {
-    // Read object metadata and update object information
-    uint32_t raw_data_index = read_le<uint32_t>( data );
-    data += 4;
+      _data_type( tdsTypeVoid ) { }
 
-    log::debug( ) << "Reading metadata for object " << _tdms_channel->_path << std::endl
-        << "raw_data_index: " << raw_data_index << std::endl;
-
-    if ( raw_data_index == 0xFFFFFFFF ) {
-      log::debug( ) << "Object has no data" << std::endl;
-      _has_data = false;
+  const daqmx_scaler& datachunk::_daqmx_scaler( ) const {
+    // the scaling says which scale the raw values feed
+    if ( _scaling ) {
+      for ( const auto& scaler : _daqmx->scalers ) {
+        if ( scaler.scale_id == _scaling->raw_scale ) {
+          return scaler;
+        }
+      }
     }
-    else if ( raw_data_index == 0x00000000 ) {
-      log::debug( ) << "Object has same data structure as in the previous segment" << std::endl;
-      _has_data = true;
+    return _daqmx->scalers.at( 0 );
+  }
+
+  tds_type_code datachunk::_stored_type( ) const {
+    if ( !_daqmx ) {
+      return (tds_type_code) _data_type.code( );
     }
-    else {
+    const daqmx_scaler& scaler = _daqmx_scaler( );
+    return ( scaler.bit >= 0 ? tdsTypeU8 : scaler.data_type );
+  }
+
+  const unsigned char* datachunk::_decode_metadata( const unsigned char* data, object_metadata& obj,
+      endianness e ) {
+    // Read object metadata, but leave the channel alone
+    obj.path = read_string_view( data, e );
+    data += 4 + obj.path.size( );
+    obj.raw_data_index = read_as<uint32_t>( data, e );
+    data += 4;
+
+    log::debug( ) << "Reading metadata for object " << obj.path << std::endl
+        << "raw_data_index: " << obj.raw_data_index << std::endl;
+
+    if ( obj.raw_data_index != 0xFFFFFFFF && obj.raw_data_index != 0x00000000 ) {
       // raw_data_index gives the length of the index information.
-      _tdms_channel->_has_data = _has_data = true;
       // Read the datatype
-      uint32_t datatype = read_le<uint32_t>( data );
+      uint32_t datatype = read_as<uint32_t>( data, e );
       data += 4;
 
       try {
-        _data_type = data_type_t::_tds_datatypes.at( datatype );
+        obj.data_type = data_type_t::from_code( datatype );
       }
       catch ( std::out_of_range& ) {
         throw std::out_of_range( "Unrecognized datatype in file" );
       }
-      if ( _tdms_channel->_data_type.is_valid( ) && _tdms_channel->_data_type != _data_type ) {
-        throw std::runtime_error( "Segment object doesn't have the same data type as previous segments" );
-      }
-      else {
-        _tdms_channel->_data_type = _data_type;
-      }
-
-      log::debug( ) << "datatype " << _data_type.name( ) << std::endl;
+      log::debug( ) << "datatype " << obj.data_type.name( ) << std::endl;
 
       // Read data dimension
-      _dimension = read_le<uint32_t>( data );
+      obj.dimension = read_as<uint32_t>( data, e );
       data += 4;
-      if ( _dimension != 1 ) {
+      if ( obj.dimension != 1 ) {
         log::debug( ) << "Warning: dimension != 1" << std::endl;
       }
 
       // Read the number of values
-      _number_values = read_le<uint64_t>( data );
+      obj.number_values = read_as<uint64_t>( data, e );
       data += 8;
 
       // Variable length datatypes have total length
-      if ( _data_type.is_string( ) ) {
-        _data_size = read_le<uint64_t>( data );
+      if ( is_daqmx( obj.raw_data_index ) ) {
+        auto daqmx = std::make_shared<daqmx_metadata>( );
+        data = decode_daqmx( data, obj.raw_data_index, e, *daqmx );
+        if ( daqmx->scalers.empty( ) ) {
+          throw std::runtime_error( "DAQmx object " + std::string( obj.path ) + " has no scalers" );
+        }
+        // the size of the raw buffers, which the segment's DAQmx channels share
+        obj.data_size = 0;
+        for ( auto width : daqmx->widths ) {
+          obj.data_size += obj.number_values * width;
+        }
+        obj.daqmx = daqmx;
+      }
+      else if ( obj.data_type.is_string( ) ) {
+        obj.data_size = read_as<uint64_t>( data, e );
         data += 8;
       }
       else {
-        _data_size = ( _number_values * _dimension * _data_type.length( ) );
+        obj.data_size = ( obj.number_values * obj.dimension * obj.data_type.length( ) );
       }
-      log::debug( ) << "Number of elements in segment for " << _tdms_channel->_path << ": " << _number_values << std::endl;
+      log::debug( ) << "Number of elements in segment for " << obj.path << ": " << obj.number_values << std::endl;
     }
     // Read data properties
-    uint32_t num_properties = read_le<uint32_t>( data );
+    uint32_t num_properties = read_as<uint32_t>( data, e );
     data += 4;
     log::debug( ) << "Reading " << num_properties << " properties" << std::endl;
+    obj.properties.clear( );
+    obj.properties.reserve( num_properties );
     for ( size_t i = 0; i < num_properties; ++i ) {
-      std::string prop_name = read_string( data );
+      std::string prop_name = read_string( data, e );
       data += 4 + prop_name.size( );
       // Property data type
-      auto prop_data_type = data_type_t::_tds_datatypes.at( read_le<uint32_t>( data ) );
+      auto prop_data_type = data_type_t::from_code( read_as<uint32_t>( data, e ) );
       data += 4;
       if ( prop_data_type.is_string( ) ) {
-        std::string* property = new std::string( read_string( data ) );
+        std::string* property = new std::string( read_string( data, e ) );
         log::debug( ) << "Property " << prop_name << ": " << *property << std::endl;
         data += 4 + property->size( );
-        _tdms_channel->_properties.emplace( prop_name,
+        obj.properties.emplace_back( prop_name,
             std::shared_ptr<channel::property>(
             new channel::property( prop_data_type, (void*) property ) ) );
       }
       else {
-        void* prop_val = prop_data_type.read( data );
+        void* prop_val;
+        if ( endianness::BIG == e && prop_data_type.length( ) <= 16 ) {
+          // the types read little-endian values
+          unsigned char swapped[16];
+          byteswap( data, prop_data_type.length( ), 1, swapped );
+          prop_val = prop_data_type.read( swapped );
+        }
+        else {
+          prop_val = prop_data_type.read( data );
+        }
         if ( prop_val == nullptr ) {
           throw std::runtime_error( "Unsupported datatype " + prop_data_type.name( ) );
         }
 
         data += prop_data_type.length( );
-        _tdms_channel->_properties.emplace( prop_name,
+        obj.properties.emplace_back( prop_name,
             std::shared_ptr<channel::property>(
             new channel::property( prop_data_type, prop_val ) ) );
         log::debug( ) << "Property " << prop_name << " has been read (" << prop_data_type.name( ) << ")" << std::endl;
@@ -141,4 +294,38 @@ namespace TDMS{
 
     return data;
   }
+
+  void datachunk::_apply_metadata( const object_metadata& obj ) {
+    // Update object information
+    if ( obj.raw_data_index == 0xFFFFFFFF ) {
+      log::debug( ) << "Object has no data" << std::endl;
+      _has_data = false;
+    }
+    else if ( obj.raw_data_index == 0x00000000 ) {
+      log::debug( ) << "Object has same data structure as in the previous segment" << std::endl;
+      _has_data = true;
+    }
+    else {
+      _tdms_channel->_has_data = _has_data = true;
+      _data_type = obj.data_type;
+      if ( _tdms_channel->_data_type.is_valid( ) && _tdms_channel->_data_type != _data_type ) {
+        throw std::runtime_error( "Segment object doesn't have the same data type as previous segments" );
+      }
+      else {
+        _tdms_channel->_data_type = _data_type;
+      }
+      _dimension = obj.dimension;
+      _number_values = obj.number_values;
+      _data_size = obj.data_size;
+      _daqmx = obj.daqmx;
+    }
+
+    for ( const auto& prop : obj.properties ) {
+      _tdms_channel->_properties.emplace( prop.first, prop.second );
+    }
+    if ( _daqmx ) {
+      // scaled with the properties as they are when the segment is written
+      _scaling = scaling::from_properties( _tdms_channel->_properties );
+    }
+  }
 }
\ No newline at end of file
@@ -14,29 +14,66 @@
 #ifndef DATACHUNK_H
 #define DATACHUNK_H
 
+#include <vector>
+#include <string_view>
+#include <memory>
+
 #include "data_type.h"
+#include "data_extraction.hpp"
 #include "tdms_exports.h"
 #include "tdms_listener.h"
 
 namespace TDMS {
   class segment;
   class channel;
+  struct object_metadata;
+  struct scaling;
+
+  /**
+   * Where one of a DAQmx channel's sets of values is in the segment's raw
+   * buffers: at byte_offset in every row of buffer number buffer
+   */
+  struct daqmx_scaler {
+    tds_type_code data_type; // the TDMS type the values are stored as
+    uint32_t buffer;
+    uint32_t byte_offset;
+    int32_t bit; // which bit of the byte a digital line is, or -1
+    uint32_t scale_id;
+  };
 
-  enum class endianness {
-    BIG,
-    LITTLE
+  /**
+   * The DAQmx raw data layout of a channel: its scalers, and the width of
+   * a row of each of the raw buffers they're in, which every DAQmx
+   * channel in a segment shares
+   */
+  struct daqmx_metadata {
+    std::vector<daqmx_scaler> scalers;
+    std::vector<uint32_t> widths;
   };
 
   class datachunk {
     friend class segment;
     friend class channel;
+    friend class tdmsfile;
   public:
-    TDMS_EXPORT datachunk( const datachunk& o );
+    TDMS_EXPORT datachunk( const datachunk& o ) = default;
+    TDMS_EXPORT datachunk& operator=( const datachunk& o ) = default;
     TDMS_EXPORT datachunk( channel * o = nullptr );
 
   private:
-    const unsigned char* _parse_metadata( const unsigned char* data );
-    size_t _read_values( const unsigned char*& data, endianness e, listener * );
+    static const unsigned char* _decode_metadata( const unsigned char* data, object_metadata& obj,
+        endianness e );
+    void _apply_metadata( const object_metadata& obj );
+    // strings is where string values are decoded to
+    size_t _read_values( const unsigned char*& data, endianness e, listener *,
+        std::vector<std::string_view>& strings ) const;
+    // whether the values are laid out the same way in both chunks
+    bool _same_layout( const datachunk& other ) const;
+    // the DAQmx scaler the values are read from
+    const daqmx_scaler& _daqmx_scaler( ) const;
+    // the TDMS type the values are stored as: the data type, or for DAQmx
+    // data the scaler's type, or a byte holding a digital line
+    tds_type_code _stored_type( ) const;
 
     channel * _tdms_channel;
     uint64_t _number_values;
@@ -44,6 +81,9 @@ namespace TDMS {
     bool _has_data;
     uint32_t _dimension;
     data_type_t _data_type;
+    // for DAQmx data
+    std::shared_ptr<const daqmx_metadata> _daqmx;
+    std::shared_ptr<const scaling> _scaling;
   };
 
 }
@@ -0,0 +1,64 @@
+#include "object_path.hpp"
+
+namespace TDMS {
+
+  bool split_path( std::string_view path, std::vector<std::string>& names ) {
+    names.clear( );
+    if ( "/" == path ) {
+      return true;
+    }
+    if ( path.empty( ) ) {
+      return false;
+    }
+
+    // every name is /'...', with any ' in it written ''
+    size_t i = 0;
+    while ( i < path.size( ) ) {
+      if ( path[i] != '/' || i + 1 >= path.size( ) || path[i + 1] != '\'' ) {
+        return false;
+      }
+      i += 2;
+      std::string name;
+      while ( true ) {
+        if ( i >= path.size( ) ) {
+          // no closing quote
+          return false;
+        }
+        if ( path[i] == '\'' ) {
+          if ( i + 1 < path.size( ) && path[i + 1] == '\'' ) {
+            name += '\'';
+            i += 2;
+            continue;
+          }
+          ++i;
+          break;
+        }
+        name += path[i++];
+      }
+      names.push_back( std::move( name ) );
+    }
+    return true;
+  }
+
+  std::string child_path( std::string_view path, std::string_view name ) {
+    std::string child( "/" == path ? std::string_view( ) : path );
+    child.reserve( child.size( ) + name.size( ) + 3 );
+    child += "/'";
+    for ( char c : name ) {
+      if ( c == '\'' ) {
+        child += '\'';
+      }
+      child += c;
+    }
+    child += '\'';
+    return child;
+  }
+
+  std::string object_path( const std::vector<std::string>& names ) {
+    std::string path( "/" );
+    for ( const auto& name : names ) {
+      path = child_path( path, name );
+    }
+    return path;
+  }
+}
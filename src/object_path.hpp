@@ -0,0 +1,28 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "tdms_exports.h"
+
+namespace TDMS {
+
+  /**
+   * Splits an object path ("/", "/'group'" or "/'group'/'channel'") into
+   * the names it is made of, undoing the doubling of quotes in them.
+   * Returns false, leaving names in an unspecified state, if the path
+   * isn't written that way.
+   */
+  TDMS_EXPORT bool split_path( std::string_view path, std::vector<std::string>& names );
+
+  /**
+   * The path of the object with the given names, from the group down;
+   * "/" for none
+   */
+  TDMS_EXPORT std::string object_path( const std::vector<std::string>& names );
+
+  /**
+   * The path of the given child of the object at path
+   */
+  TDMS_EXPORT std::string child_path( std::string_view path, std::string_view name );
+}
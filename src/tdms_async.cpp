@@ -0,0 +1,359 @@
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define TDMS_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+#endif
+
+#include "tdms_async.hpp"
+#include "tdms_io.hpp"
+#include "log.hpp"
+
+namespace TDMS{
+
+  class async_reader::impl {
+  public:
+
+    impl( unsigned depth ) : _depth( depth ), _in_flight( 0 ) { }
+
+    virtual ~impl( ) { }
+    virtual void submit( unsigned long long offset, void * buffer, size_t len, size_t tag ) = 0;
+    virtual size_t complete( size_t& bytes ) = 0;
+    virtual bool uses_io_uring( ) const = 0;
+
+    unsigned _depth;
+    size_t _in_flight;
+  };
+
+  namespace {
+
+    // the fallback: a pool of threads doing blocking reads
+    class thread_reader : public async_reader::impl {
+    public:
+
+      thread_reader( FILE * f, unsigned depth ) : impl( depth ), _f( f ), _stopping( false ) {
+        for ( unsigned i = 0; i < depth; ++i ) {
+          _pool.emplace_back( [this]( ) {
+            work( );
+          } );
+        }
+      }
+
+      virtual ~thread_reader( ) {
+        {
+          std::lock_guard<std::mutex> lock( _lock );
+          _stopping = true;
+        }
+        _wakeup.notify_all( );
+        for ( auto& t : _pool ) {
+          t.join( );
+        }
+      }
+
+      virtual void submit( unsigned long long offset, void * buffer, size_t len, size_t tag ) override {
+        {
+          std::lock_guard<std::mutex> lock( _lock );
+          _requests.push_back( request{ offset, buffer, len, tag } );
+        }
+        ++_in_flight;
+        _wakeup.notify_one( );
+      }
+
+      virtual size_t complete( size_t& bytes ) override {
+        std::unique_lock<std::mutex> lock( _lock );
+        _done.wait( lock, [this]( ) {
+          return !_completions.empty( );
+        } );
+        auto c = _completions.front( );
+        _completions.pop_front( );
+        --_in_flight;
+        bytes = c.len;
+        return c.tag;
+      }
+
+      virtual bool uses_io_uring( ) const override {
+        return false;
+      }
+
+    private:
+
+      struct request {
+        unsigned long long offset;
+        void * buffer;
+        size_t len;
+        size_t tag;
+      };
+
+      void work( ) {
+        std::unique_lock<std::mutex> lock( _lock );
+        while ( true ) {
+          _wakeup.wait( lock, [this]( ) {
+            return _stopping || !_requests.empty( );
+          } );
+          if ( _requests.empty( ) ) {
+            return;
+          }
+          auto r = _requests.front( );
+          _requests.pop_front( );
+          lock.unlock( );
+
+          r.len = read_at( _f, r.offset, r.buffer, r.len );
+
+          lock.lock( );
+          _completions.push_back( r );
+          _done.notify_one( );
+        }
+      }
+
+      FILE * _f;
+      bool _stopping;
+      std::mutex _lock;
+      std::condition_variable _wakeup;
+      std::condition_variable _done;
+      std::deque<request> _requests;
+      std::deque<request> _completions;
+      std::vector<std::thread> _pool;
+    };
+
+#ifdef TDMS_HAVE_IO_URING
+
+    // talks to the kernel's io_uring interface directly, so there's no
+    // need for liburing
+    class uring_reader : public async_reader::impl {
+    public:
+
+      uring_reader( FILE * f, unsigned depth ) : impl( depth ), _fd( fileno( f ) ), _ring( -1 ),
+          _sq( MAP_FAILED ), _cq( MAP_FAILED ), _sqes( MAP_FAILED ), _slots( depth ) {
+        io_uring_params params;
+        memset( &params, 0, sizeof ( params ) );
+        _ring = (int) syscall( __NR_io_uring_setup, depth, &params );
+        if ( _ring < 0 ) {
+          throw std::runtime_error( "io_uring is not available" );
+        }
+
+        _sq_size = params.sq_off.array + params.sq_entries * sizeof ( unsigned );
+        _cq_size = params.cq_off.cqes + params.cq_entries * sizeof ( io_uring_cqe );
+        bool single = ( params.features & IORING_FEAT_SINGLE_MMAP );
+        if ( single ) {
+          _sq_size = _cq_size = std::max( _sq_size, _cq_size );
+        }
+        _sq = mmap( nullptr, _sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            _ring, IORING_OFF_SQ_RING );
+        _cq = ( single
+            ? _sq
+            : mmap( nullptr, _cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            _ring, IORING_OFF_CQ_RING ) );
+        _sqes_size = params.sq_entries * sizeof ( io_uring_sqe );
+        _sqes = mmap( nullptr, _sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            _ring, IORING_OFF_SQES );
+        if ( MAP_FAILED == _sq || MAP_FAILED == _cq || MAP_FAILED == _sqes ) {
+          release( );
+          throw std::runtime_error( "io_uring rings could not be mapped" );
+        }
+
+        unsigned char * sq = (unsigned char *) _sq;
+        unsigned char * cq = (unsigned char *) _cq;
+        _sq_tail = (unsigned *) ( sq + params.sq_off.tail );
+        _sq_mask = *(unsigned *) ( sq + params.sq_off.ring_mask );
+        _sq_array = (unsigned *) ( sq + params.sq_off.array );
+        _cq_head = (unsigned *) ( cq + params.cq_off.head );
+        _cq_tail = (unsigned *) ( cq + params.cq_off.tail );
+        _cq_mask = *(unsigned *) ( cq + params.cq_off.ring_mask );
+        _cqes = (io_uring_cqe *) ( cq + params.cq_off.cqes );
+
+        for ( unsigned i = 0; i < depth; ++i ) {
+          _free.push_back( i );
+        }
+      }
+
+      virtual ~uring_reader( ) {
+        // the kernel may still write into our buffers, so wait for them
+        while ( _in_flight > 0 ) {
+          size_t bytes;
+          complete( bytes );
+        }
+        release( );
+      }
+
+      virtual void submit( unsigned long long offset, void * buffer, size_t len, size_t tag ) override {
+        if ( _free.empty( ) ) {
+          throw std::runtime_error( "too many reads in flight" );
+        }
+        unsigned s = _free.back( );
+        _free.pop_back( );
+        _slots[s] = slot{ offset, (unsigned char *) buffer, len, 0, tag, { } };
+        queue( s );
+      }
+
+      virtual size_t complete( size_t& bytes ) override {
+        while ( true ) {
+          unsigned head = *_cq_head;
+          if ( head == __atomic_load_n( _cq_tail, __ATOMIC_ACQUIRE ) ) {
+            if ( syscall( __NR_io_uring_enter, _ring, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0 ) < 0
+                && EINTR != errno ) {
+              throw std::runtime_error( "io_uring wait failed" );
+            }
+            continue;
+          }
+
+          io_uring_cqe cqe = _cqes[head & _cq_mask];
+          __atomic_store_n( _cq_head, head + 1, __ATOMIC_RELEASE );
+
+          unsigned s = (unsigned) cqe.user_data;
+          slot& sl = _slots[s];
+          if ( cqe.res > 0 ) {
+            sl.done += cqe.res;
+          }
+          bool retry = ( -EINTR == cqe.res || -EAGAIN == cqe.res );
+          if ( ( cqe.res > 0 && sl.done < sl.len ) || retry ) {
+            // short read: ask for the rest
+            queue( s );
+            continue;
+          }
+
+          bytes = sl.done;
+          _free.push_back( s );
+          --_in_flight;
+          return sl.tag;
+        }
+      }
+
+      virtual bool uses_io_uring( ) const override {
+        return true;
+      }
+
+    private:
+
+      struct slot {
+        unsigned long long offset;
+        unsigned char * buffer;
+        size_t len;
+        size_t done;
+        size_t tag;
+        iovec iov;
+      };
+
+      void queue( unsigned s ) {
+        slot& sl = _slots[s];
+        sl.iov.iov_base = sl.buffer + sl.done;
+        sl.iov.iov_len = sl.len - sl.done;
+
+        unsigned tail = *_sq_tail;
+        unsigned idx = tail & _sq_mask;
+        io_uring_sqe * sqe = ( (io_uring_sqe *) _sqes ) + idx;
+        memset( sqe, 0, sizeof ( io_uring_sqe ) );
+        sqe->opcode = IORING_OP_READV;
+        sqe->fd = _fd;
+        sqe->addr = (unsigned long long) &sl.iov;
+        sqe->len = 1;
+        sqe->off = sl.offset + sl.done;
+        sqe->user_data = s;
+        _sq_array[idx] = idx;
+        __atomic_store_n( _sq_tail, tail + 1, __ATOMIC_RELEASE );
+
+        if ( 0 == sl.done ) {
+          ++_in_flight;
+        }
+        while ( syscall( __NR_io_uring_enter, _ring, 1, 0, 0, nullptr, 0 ) < 0 ) {
+          if ( EINTR != errno && EAGAIN != errno ) {
+            throw std::runtime_error( "io_uring submit failed" );
+          }
+        }
+      }
+
+      void release( ) {
+        if ( MAP_FAILED != _sqes ) {
+          munmap( _sqes, _sqes_size );
+        }
+        if ( MAP_FAILED != _cq && _cq != _sq ) {
+          munmap( _cq, _cq_size );
+        }
+        if ( MAP_FAILED != _sq ) {
+          munmap( _sq, _sq_size );
+        }
+        if ( _ring >= 0 ) {
+          close( _ring );
+        }
+      }
+
+      int _fd;
+      int _ring;
+      void * _sq;
+      void * _cq;
+      void * _sqes;
+      size_t _sq_size;
+      size_t _cq_size;
+      size_t _sqes_size;
+      unsigned * _sq_tail;
+      unsigned _sq_mask;
+      unsigned * _sq_array;
+      unsigned * _cq_head;
+      unsigned * _cq_tail;
+      unsigned _cq_mask;
+      io_uring_cqe * _cqes;
+      std::vector<slot> _slots;
+      std::vector<unsigned> _free;
+    };
+
+#endif
+  }
+
+  async_reader::async_reader( FILE * f, unsigned queue_depth ) {
+    if ( 0 == queue_depth ) {
+      queue_depth = 1;
+    }
+#ifdef TDMS_HAVE_IO_URING
+    try {
+      _impl.reset( new uring_reader( f, queue_depth ) );
+    }
+    catch ( std::exception& x ) {
+      log::debug( ) << x.what( ) << "; using a thread pool for reads" << std::endl;
+    }
+#endif
+    if ( !_impl ) {
+      _impl.reset( new thread_reader( f, queue_depth ) );
+    }
+  }
+
+  async_reader::~async_reader( ) { }
+
+  void async_reader::submit( unsigned long long offset, void * buffer, size_t len, size_t tag ) {
+    if ( _impl->_in_flight >= _impl->_depth ) {
+      throw std::runtime_error( "too many reads in flight" );
+    }
+    _impl->submit( offset, buffer, len, tag );
+  }
+
+  size_t async_reader::complete( size_t& bytes ) {
+    if ( 0 == _impl->_in_flight ) {
+      throw std::runtime_error( "no reads in flight" );
+    }
+    return _impl->complete( bytes );
+  }
+
+  size_t async_reader::in_flight( ) const {
+    return _impl->_in_flight;
+  }
+
+  unsigned async_reader::queue_depth( ) const {
+    return _impl->_depth;
+  }
+
+  bool async_reader::uses_io_uring( ) const {
+    return _impl->uses_io_uring( );
+  }
+}
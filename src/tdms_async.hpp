@@ -0,0 +1,47 @@
+#pragma once
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+
+#include "tdms_exports.h"
+
+namespace TDMS {
+
+  /**
+   * Keeps many positional reads of one file in flight at once. Reads go
+   * through io_uring where the kernel offers it, and through a pool of
+   * threads doing read_at() everywhere else.
+   *
+   * Only one thread may submit() and complete() at a time.
+   */
+  class async_reader {
+  public:
+    TDMS_EXPORT async_reader( FILE * f, unsigned queue_depth );
+    TDMS_EXPORT async_reader( const async_reader& ) = delete;
+    TDMS_EXPORT async_reader& operator=(const async_reader&) = delete;
+    TDMS_EXPORT virtual ~async_reader( );
+
+    /**
+     * Queues a read of len bytes at offset into buffer. At most
+     * queue_depth( ) reads can be in flight at once.
+     */
+    TDMS_EXPORT void submit( unsigned long long offset, void * buffer, size_t len, size_t tag );
+
+    /**
+     * Waits for any of the queued reads to finish, and returns the tag it
+     * was submitted with. bytes is set to the number of bytes read, which
+     * is less than requested only at the end of the file or on errors.
+     */
+    TDMS_EXPORT size_t complete( size_t& bytes );
+
+    TDMS_EXPORT size_t in_flight( ) const;
+
+    TDMS_EXPORT unsigned queue_depth( ) const;
+
+    TDMS_EXPORT bool uses_io_uring( ) const;
+
+    class impl;
+  private:
+    std::unique_ptr<impl> _impl;
+  };
+}
@@ -0,0 +1,353 @@
+#include <stdexcept>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <stdio.h>
+
+#include "tdms_file.hpp"
+#include "log.hpp"
+#include "tdms_segment.hpp"
+#include "tdms_channel.h"
+#include "tdms_exceptions.h"
+#include "data_scaling.hpp"
+
+// Snapshots of the parsed metadata of a file. The snapshot is written in
+// native byte order, and only ever read back on the machine that wrote it.
+
+namespace TDMS{
+
+  namespace {
+    const char cache_magic[8] = { 'T', 'D', 'M', 'S', 'p', 'p', 'C', '\0' };
+    const uint32_t cache_version = 6;
+    const uint32_t byte_order_mark = 0x01020304;
+
+    class cache_writer {
+    public:
+
+      template<typename T> void put( T val ) {
+        const unsigned char * p = (const unsigned char *) &val;
+        buffer.insert( buffer.end( ), p, p + sizeof ( T ) );
+      }
+
+      void put( const std::string& str ) {
+        put<uint32_t>( str.size( ) );
+        buffer.insert( buffer.end( ), str.begin( ), str.end( ) );
+      }
+
+      void put( const void * data, size_t len ) {
+        const unsigned char * p = (const unsigned char *) data;
+        buffer.insert( buffer.end( ), p, p + len );
+      }
+
+      std::vector<unsigned char> buffer;
+    };
+
+    class cache_reader {
+    public:
+
+      cache_reader( const std::vector<unsigned char>& buf ) : _pos( buf.data( ) ),
+          _end( buf.data( ) + buf.size( ) ) { }
+
+      template<typename T> T get( ) {
+        T val;
+        memcpy( &val, take( sizeof ( T ) ), sizeof ( T ) );
+        return val;
+      }
+
+      std::string get_string( ) {
+        uint32_t len = get<uint32_t>( );
+        return std::string( (const char *) take( len ), len );
+      }
+
+      const unsigned char * take( size_t len ) {
+        if ( len > (size_t) ( _end - _pos ) ) {
+          throw read_error( );
+        }
+        const unsigned char * p = _pos;
+        _pos += len;
+        return p;
+      }
+
+      bool done( ) const {
+        return _pos == _end;
+      }
+    private:
+      const unsigned char * _pos;
+      const unsigned char * _end;
+    };
+
+    void put_type( cache_writer& w, const data_type_t& dt ) {
+      // channels without data (and the chunks for them) never get a type
+      w.put<uint8_t>( dt.is_valid( ) );
+      if ( !dt.is_valid( ) ) {
+        return;
+      }
+      w.put<uint32_t>( dt.code( ) );
+    }
+
+    data_type_t get_type( cache_reader& r ) {
+      if ( 0 == r.get<uint8_t>( ) ) {
+        return data_type_t( );
+      }
+      return data_type_t::from_code( r.get<uint32_t>( ) );
+    }
+
+    void put_daqmx( cache_writer& w, const std::shared_ptr<const daqmx_metadata>& daqmx ) {
+      w.put<uint8_t>( nullptr != daqmx );
+      if ( nullptr == daqmx ) {
+        return;
+      }
+      w.put<uint32_t>( daqmx->scalers.size( ) );
+      for ( const auto& scaler : daqmx->scalers ) {
+        w.put<uint32_t>( scaler.data_type );
+        w.put<uint32_t>( scaler.buffer );
+        w.put<uint32_t>( scaler.byte_offset );
+        w.put<int32_t>( scaler.bit );
+        w.put<uint32_t>( scaler.scale_id );
+      }
+      w.put<uint32_t>( daqmx->widths.size( ) );
+      for ( auto width : daqmx->widths ) {
+        w.put<uint32_t>( width );
+      }
+    }
+
+    std::shared_ptr<const daqmx_metadata> get_daqmx( cache_reader& r ) {
+      if ( 0 == r.get<uint8_t>( ) ) {
+        return nullptr;
+      }
+      auto daqmx = std::make_shared<daqmx_metadata>( );
+      daqmx->scalers.resize( r.get<uint32_t>( ) );
+      for ( auto& scaler : daqmx->scalers ) {
+        scaler.data_type = (tds_type_code) r.get<uint32_t>( );
+        scaler.buffer = r.get<uint32_t>( );
+        scaler.byte_offset = r.get<uint32_t>( );
+        scaler.bit = r.get<int32_t>( );
+        scaler.scale_id = r.get<uint32_t>( );
+      }
+      daqmx->widths.resize( r.get<uint32_t>( ) );
+      for ( auto& width : daqmx->widths ) {
+        width = r.get<uint32_t>( );
+      }
+      return daqmx;
+    }
+
+    int64_t modification_time( const std::string& filename ) {
+      return std::filesystem::last_write_time( filename ).time_since_epoch( ).count( );
+    }
+  }
+
+  std::string tdmsfile::_cache_filename( ) const {
+    if ( _opts.cache_directory.empty( ) ) {
+      return filename + ".tdmspp_cache";
+    }
+
+    // different directories can hold files with the same name, so
+    // tell the snapshots apart by the full path, too
+    auto path = std::filesystem::absolute( filename );
+    char hash[32];
+    snprintf( hash, sizeof ( hash ), "%016llx", (unsigned long long) std::hash<std::string>{ }( path.string( ) ) );
+    return ( std::filesystem::path( _opts.cache_directory )
+        / ( path.filename( ).string( ) + "." + hash + ".tdmspp_cache" ) ).string( );
+  }
+
+  bool tdmsfile::_load_cache( ) {
+    std::string cachefile = _cache_filename( );
+    std::vector<unsigned char> buf;
+    FILE * cf = fopen( cachefile.c_str( ), "rb" );
+    if ( nullptr == cf ) {
+      return false;
+    }
+    fseek( cf, 0, SEEK_END );
+    buf.resize( ftell( cf ) );
+    fseek( cf, 0, SEEK_SET );
+    bool ok = ( fread( buf.data( ), 1, buf.size( ), cf ) == buf.size( ) );
+    fclose( cf );
+    if ( !ok ) {
+      return false;
+    }
+
+    try {
+      cache_reader r( buf );
+      if ( memcmp( r.take( sizeof ( cache_magic ) ), cache_magic, sizeof ( cache_magic ) ) != 0
+          || r.get<uint32_t>( ) != cache_version
+          || r.get<uint32_t>( ) != byte_order_mark
+          || r.get<uint64_t>( ) != file_contents_size
+          || r.get<int64_t>( ) != modification_time( filename ) ) {
+        log::debug( ) << "metadata snapshot " << cachefile << " is stale" << std::endl;
+        return false;
+      }
+
+      std::vector<channel *> channels( r.get<uint64_t>( ) );
+      for ( auto& c : channels ) {
+        c = find_or_make_channel( r.get_string( ) );
+        c->_made_up = ( r.get<uint8_t>( ) != 0 );
+        c->_has_data = ( r.get<uint8_t>( ) != 0 );
+        c->_data_type = get_type( r );
+        c->_number_values = r.get<uint64_t>( );
+
+        uint32_t num_properties = r.get<uint32_t>( );
+        for ( uint32_t i = 0; i < num_properties; ++i ) {
+          std::string name = r.get_string( );
+          auto prop_data_type = get_type( r );
+          void * value;
+          if ( prop_data_type.is_string( ) ) {
+            value = new std::string( r.get_string( ) );
+          }
+          else {
+            // held until it's copied, so a short snapshot doesn't leak it
+            std::unique_ptr<void, decltype( &free )> bytes( malloc( prop_data_type.ctype_length( ) ), &free );
+            memcpy( bytes.get( ), r.take( prop_data_type.ctype_length( ) ), prop_data_type.ctype_length( ) );
+            value = bytes.release( );
+          }
+          c->_properties.emplace( name,
+              std::shared_ptr<channel::property>( new channel::property( prop_data_type, value ) ) );
+        }
+      }
+
+      // each layout is stored once, however many segments share it
+      std::vector<std::shared_ptr<const segment::chunk_layout>> layouts( r.get<uint64_t>( ) );
+      for ( auto& layout : layouts ) {
+        auto chunks = std::make_shared<segment::chunk_layout>( r.get<uint32_t>( ) );
+        for ( auto& chunk : *chunks ) {
+          chunk._tdms_channel = channels.at( r.get<uint32_t>( ) );
+          chunk._number_values = r.get<uint64_t>( );
+          chunk._data_size = r.get<uint64_t>( );
+          chunk._has_data = ( r.get<uint8_t>( ) != 0 );
+          chunk._dimension = r.get<uint32_t>( );
+          chunk._data_type = get_type( r );
+          chunk._daqmx = get_daqmx( r );
+          if ( chunk._daqmx ) {
+            chunk._scaling = scaling::from_properties( chunk._tdms_channel->_properties );
+          }
+        }
+        layout = std::move( chunks );
+      }
+
+      uint64_t num_runs = r.get<uint64_t>( );
+      _segments.reserve( num_runs );
+      for ( uint64_t i = 0; i < num_runs; ++i ) {
+        std::unique_ptr<segment> s( new segment( r.get<uint64_t>( ), this ) );
+        s->_next_segment_offset = r.get<uint64_t>( );
+        s->_data_offset = r.get<int64_t>( );
+        s->_num_chunks = r.get<uint64_t>( );
+        s->_toc = r.get<uint32_t>( );
+        s->_run_length = r.get<uint64_t>( );
+        if ( 0 == s->_run_length ) {
+          throw read_error( );
+        }
+        s->_ordered_chunks = layouts.at( r.get<uint64_t>( ) );
+        if ( _segments.empty( ) || s->_ordered_chunks != _segments.back( )->_ordered_chunks ) {
+          for ( const auto& chunk : *s->_ordered_chunks ) {
+            // the last segment that holds a channel holds the chunk
+            // the next segment would inherit
+            chunk._tdms_channel->_previous_segment_chunk = chunk;
+          }
+        }
+        s->_index_chunks( );
+        _append_segment( std::move( s ) );
+      }
+
+      if ( !r.done( ) ) {
+        throw read_error( );
+      }
+    }
+    catch ( std::exception& x ) {
+      log::debug( ) << "metadata snapshot " << cachefile << " is unusable (" << x.what( ) << ")" << std::endl;
+      _segments.clear( );
+      _channels.clear( );
+      _decoded_segments = 0;
+      return false;
+    }
+    return true;
+  }
+
+  void tdmsfile::_save_cache( ) {
+    cache_writer w;
+    w.put( cache_magic, sizeof ( cache_magic ) );
+    w.put<uint32_t>( cache_version );
+    w.put<uint32_t>( byte_order_mark );
+    w.put<uint64_t>( file_contents_size );
+
+    std::string cachefile = _cache_filename( );
+    try {
+      w.put<int64_t>( modification_time( filename ) );
+
+      // in ID order, so they get the same IDs when they're read back
+      w.put<uint64_t>( _channels.size( ) );
+      for ( uint32_t id = 0; id < _channels.size( ); ++id ) {
+        const channel * c = _channels[id];
+        w.put( c->_path );
+        w.put<uint8_t>( c->_made_up );
+        w.put<uint8_t>( c->_has_data );
+        put_type( w, c->_data_type );
+        w.put<uint64_t>( c->_number_values );
+
+        w.put<uint32_t>( c->_properties.size( ) );
+        for ( const auto& p : c->_properties ) {
+          w.put( p.first );
+          put_type( w, p.second->data_type );
+          if ( p.second->data_type.is_string( ) ) {
+            w.put( p.second->asString( ) );
+          }
+          else {
+            w.put( p.second->value, p.second->data_type.ctype_length( ) );
+          }
+        }
+      }
+
+      std::map<const segment::chunk_layout *, uint64_t> layout_ids;
+      std::vector<const segment::chunk_layout *> layouts;
+      for ( const auto& s : _segments ) {
+        if ( layout_ids.emplace( s->_ordered_chunks.get( ), layouts.size( ) ).second ) {
+          layouts.push_back( s->_ordered_chunks.get( ) );
+        }
+      }
+      w.put<uint64_t>( layouts.size( ) );
+      for ( const auto * layout : layouts ) {
+        w.put<uint32_t>( layout->size( ) );
+        for ( const auto& chunk : *layout ) {
+          w.put<uint32_t>( chunk._tdms_channel->_id );
+          w.put<uint64_t>( chunk._number_values );
+          w.put<uint64_t>( chunk._data_size );
+          w.put<uint8_t>( chunk._has_data );
+          w.put<uint32_t>( chunk._dimension );
+          put_type( w, chunk._data_type );
+          put_daqmx( w, chunk._daqmx );
+        }
+      }
+
+      w.put<uint64_t>( _segments.size( ) );
+      for ( const auto& s : _segments ) {
+        w.put<uint64_t>( s->_startpos_in_file );
+        w.put<uint64_t>( s->_next_segment_offset );
+        w.put<int64_t>( s->_data_offset );
+        w.put<uint64_t>( s->_num_chunks );
+        w.put<uint32_t>( s->_toc );
+        w.put<uint64_t>( s->_run_length );
+        w.put<uint64_t>( layout_ids.at( s->_ordered_chunks.get( ) ) );
+      }
+    }
+    catch ( std::exception& x ) {
+      log::debug( ) << "not writing metadata snapshot (" << x.what( ) << ")" << std::endl;
+      return;
+    }
+
+    // write to a temporary file first, so readers never see half a snapshot
+    std::string tmpfile = cachefile + ".tmp";
+    FILE * cf = fopen( tmpfile.c_str( ), "wb" );
+    if ( nullptr == cf ) {
+      log::debug( ) << "could not write metadata snapshot " << cachefile << std::endl;
+      return;
+    }
+    bool ok = ( fwrite( w.buffer.data( ), 1, w.buffer.size( ), cf ) == w.buffer.size( ) );
+    ok = ( 0 == fclose( cf ) ) && ok;
+    if ( !ok || 0 != std::rename( tmpfile.c_str( ), cachefile.c_str( ) ) ) {
+      log::debug( ) << "could not write metadata snapshot " << cachefile << std::endl;
+      std::remove( tmpfile.c_str( ) );
+    }
+  }
+}
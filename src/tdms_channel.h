@@ -17,12 +17,91 @@
 #include "tdms_exports.h"
 #include "data_type.h"
 #include "datachunk.h"
+#include <map>
 #include <memory>
+#include <new>
+#include <stdexcept>
+#include <vector>
+#include <string>
+#include <string_view>
 
 namespace TDMS {
   class tdmsfile;
   class segment;
   class datachunk;
+
+  /**
+   * Hands out memory aligned to Alignment bytes, so whole cache lines (and
+   * SIMD registers) line up with the values. Elements are default-
+   * initialized, so a buffer that is about to be read into isn't zeroed
+   * first.
+   */
+  template<typename T, size_t Alignment = 64>
+  struct aligned_allocator {
+    typedef T value_type;
+
+    template<typename U>
+    struct rebind {
+      typedef aligned_allocator<U, Alignment> other;
+    };
+
+    aligned_allocator( ) = default;
+
+    template<typename U>
+    aligned_allocator( const aligned_allocator<U, Alignment>& ) { }
+
+    T * allocate( size_t n ) {
+      return static_cast<T *> ( ::operator new( n * sizeof ( T ), std::align_val_t( Alignment ) ) );
+    }
+
+    void deallocate( T * p, size_t /*n*/ ) {
+      ::operator delete( p, std::align_val_t( Alignment ) );
+    }
+
+    template<typename U, typename... Args>
+    void construct( U * p, Args&&... args ) {
+      ::new( (void *) p ) U( std::forward<Args>( args )... );
+    }
+
+    template<typename U>
+    void construct( U * p ) {
+      ::new( (void *) p ) U;
+    }
+
+    template<typename U>
+    bool operator==(const aligned_allocator<U, Alignment>& ) const {
+      return true;
+    }
+
+    template<typename U>
+    bool operator!=(const aligned_allocator<U, Alignment>& ) const {
+      return false;
+    }
+  };
+
+  template<typename T>
+  using aligned_vector = std::vector<T, aligned_allocator<T>>;
+
+  /**
+   * Where a run of a channel's values sits in segments of seg's run,
+   * from its member first_member on: num_chunks chunks of
+   * values_per_chunk values each in every segment, starting offset bytes
+   * into every chunk_size-byte chunk of the segment's raw data, and
+   * stride bytes apart. chunk is the channel's entry in the segment's
+   * layout, which says how the values are stored.
+   */
+  struct data_extent {
+    segment * seg;
+    const datachunk * chunk;
+    uint64_t first_value;
+    uint64_t values_per_chunk;
+    uint64_t num_chunks;
+    uint64_t offset;
+    uint64_t chunk_size;
+    uint64_t stride;
+    uint64_t first_member;
+    uint64_t segments;
+  };
   
   class channel {
     friend class tdmsfile;
@@ -53,7 +132,11 @@ namespace TDMS {
       }
 
       TDMS_EXPORT time_t asUTCTimestamp( ) const {
-        return *( (time_t*) value );
+        return asTimestamp( ).unix_time( );
+      }
+
+      TDMS_EXPORT const timestamp& asTimestamp( ) const {
+        return *( (timestamp*) value );
       }
 
       const data_type_t data_type;
@@ -76,6 +159,52 @@ namespace TDMS {
       return _path;
     }
 
+    /**
+     * The channel's number in its file (see tdmsfile::channel_by_id)
+     */
+    TDMS_EXPORT uint32_t id( ) const {
+      return _id;
+    }
+
+    /**
+     * The last name in the path, unquoted: the group's name for a group,
+     * and empty for the file itself. Objects whose paths can't be split
+     * up are named after their whole paths.
+     */
+    TDMS_EXPORT const std::string& name( ) const {
+      return _name;
+    }
+
+    /**
+     * The object this one is in: the file's object ("/") for a group,
+     * and the group for a channel. nullptr for the file's object, and
+     * for objects whose paths can't be split up.
+     */
+    TDMS_EXPORT channel * parent( ) const {
+      return _parent;
+    }
+
+    /**
+     * Whether the file never mentions this object, which was made up as
+     * the parent of objects it does mention. Made-up objects have no
+     * properties or values, and iterating the file skips them.
+     */
+    TDMS_EXPORT bool made_up( ) const {
+      return _made_up;
+    }
+
+    /**
+     * The objects in this one, in the order the file first mentions them
+     */
+    TDMS_EXPORT const std::vector<channel *>& children( ) const {
+      return _children;
+    }
+
+    /**
+     * The object in this one with the given name, or nullptr
+     */
+    TDMS_EXPORT channel * child( const std::string& name ) const;
+
     TDMS_EXPORT std::map<std::string, std::shared_ptr<property>> get_properties( ) const {
       return _properties;
     }
@@ -83,10 +212,57 @@ namespace TDMS {
     TDMS_EXPORT bool has_previous( ) const {
       return ( nullptr != _previous_segment_chunk._tdms_channel );
     }
+
+    /**
+     * Reads count values, starting at value number start, into out. T is
+     * the C type the channel's values decode to (see tds_type), or, for
+     * numeric channels, any other numeric type they're converted to on
+     * the way (see convert). With scaled set, the values are scaled by the
+     * channel's NI_Scale properties too, which needs T to be float or
+     * double. DAQmx values are scaled the way the loaders scale them,
+     * with the scaling of the segment they're in. Values stored as they decode
+     * are copied from the file straight into out. Returns the number of
+     * values read, which is less than count only if the channel ends first.
+     */
+    template<typename T>
+    size_t read_into( uint64_t start, T * out, size_t count, bool scaled = false ) {
+      return _read_values( start, count, out, tds_type<T>::code, scaled );
+    }
+
+    /**
+     * Reads all of the channel's values into out, which has room for
+     * capacity of them
+     */
+    template<typename T>
+    size_t read_all( T * out, size_t capacity, bool scaled = false ) {
+      if ( capacity < _number_values ) {
+        throw std::length_error( "Not enough room for the values of " + _path );
+      }
+      return read_into( 0, out, _number_values, scaled );
+    }
+
+    /**
+     * Reads all of the channel's values into a new 64-byte aligned buffer
+     */
+    template<typename T>
+    aligned_vector<T> read_all( bool scaled = false ) {
+      aligned_vector<T> values( _number_values );
+      values.resize( read_into( 0, values.data( ), values.size( ), scaled ) );
+      return values;
+    }
   private:
+    TDMS_EXPORT size_t _read_values( uint64_t start, size_t count, void * out, uint32_t as, bool scaled );
+
+    tdmsfile * _file;
+
     datachunk _previous_segment_chunk;
 
     const std::string _path;
+    uint32_t _id;
+    std::string _name;
+    channel * _parent;
+    std::vector<channel *> _children;
+    bool _made_up;
     bool _has_data;
 
     data_type_t _data_type;
@@ -96,6 +272,26 @@ namespace TDMS {
     std::map<std::string, std::shared_ptr<property>> _properties;
 
     size_t _number_values;
+
+    // where the values are, in file order
+    std::vector<data_extent> _extents;
+  };
+
+  /**
+   * An object's metadata as it is stored in one segment, before it has
+   * been matched up with its channel and the earlier segments. The path
+   * points into the metadata it was decoded from, which has to be kept
+   * until then.
+   */
+  struct object_metadata {
+    std::string_view path;
+    uint32_t raw_data_index = 0xFFFFFFFF;
+    data_type_t data_type;
+    uint32_t dimension = 1;
+    uint64_t number_values = 0;
+    uint64_t data_size = 0;
+    std::shared_ptr<const daqmx_metadata> daqmx;
+    std::vector<std::pair<std::string, std::shared_ptr<channel::property>>> properties;
   };
 }
 
@@ -14,6 +14,7 @@
 #ifndef TDMS_EXCEPTIONS_H
 #define TDMS_EXCEPTIONS_H
 
+#include <stdexcept>
 #include "tdms_exports.h"
 
 namespace TDMS {
@@ -24,6 +25,12 @@ namespace TDMS {
       TDMS_EXPORT no_segment_error( ) : std::runtime_error( "Not a segment" ) { }
   };
 
+  class incomplete_segment_error : public std::runtime_error {
+  public:
+
+      TDMS_EXPORT incomplete_segment_error( ) : std::runtime_error( "Segment is incomplete" ) { }
+  };
+
   class read_error : public std::runtime_error {
   public:
 
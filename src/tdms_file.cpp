@@ -4,80 +4,1178 @@
 #include <cstdint>
 #include <algorithm>
 #include <map>
+#include <set>
 #include <stdio.h>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include <exception>
+#include <optional>
 
 #include "tdms_file.hpp"
 #include "log.hpp"
 #include "tdms_segment.hpp"
 #include "tdms_channel.h"
 #include "tdms_exceptions.h"
+#include "data_extraction.hpp"
+#include "tdms_threads.hpp"
+#include "tdms_async.hpp"
+#include "data_kernels.hpp"
+#include "data_conversion.hpp"
+#include "data_scaling.hpp"
 
 namespace TDMS{
   typedef unsigned long long uulong;
 
-  tdmsfile::tdmsfile( const std::string& filename ) : filename( filename ) {
+  /**
+   * Reads lead-ins ahead of a pass over the file. The pass says where it
+   * expects the next segments to start (every so many bytes from here,
+   * or at offsets it knows already), and reads of those are kept in
+   * flight through an async_reader, so it rarely waits on a read.
+   */
+  class leadin_reader {
+  public:
 
-    f = fopen( filename.c_str( ), "rb" );
-    if ( nullptr == f ) {
-      throw std::runtime_error( "File \"" + filename + "\" could not be opened" );
+    leadin_reader( FILE * f, unsigned queue_depth )
+        : _slots( queue_depth ), _reader( f, queue_depth ), _next( 0 ), _stride( 0 ), _len( 0 ),
+        _held( no_slot ) {
+      for ( size_t i = _slots.size( ); i > 0; --i ) {
+        _free.push_back( i - 1 );
+      }
+    }
+
+    /**
+     * Expects segments at offset, offset + stride, ... (up to end), and
+     * reads len bytes at each. Reads of earlier guesses that don't fit
+     * the pattern are dropped.
+     */
+    void guess( uulong offset, uulong stride, size_t len, uulong end ) {
+      uulong first = ( _queue.empty( ) ? _next : _slots[_queue.front( )].offset );
+      if ( stride != _stride || len != _len || offset != first ) {
+        _drop( );
+        _next = offset;
+        _stride = stride;
+        _len = len;
+      }
+      while ( _stride > 0 && _next < end && end - _next >= 28
+          && expect( _next, std::min<uulong>( _len, end - _next ) ) ) {
+        _next += _stride;
+      }
+    }
+
+    /**
+     * Reads len bytes at offset, after the reads queued already, if there
+     * is room for another read; returns whether there was
+     */
+    bool expect( uulong offset, size_t len ) {
+      if ( _free.empty( ) ) {
+        return false;
+      }
+      size_t s = _free.back( );
+      _free.pop_back( );
+      slot& sl = _slots[s];
+      sl.offset = offset;
+      sl.done = false;
+      sl.buffer.resize( len );
+      _reader.submit( sl.offset, sl.buffer.data( ), sl.buffer.size( ), s );
+      _queue.push_back( s );
+      return true;
+    }
+
+    /**
+     * The bytes read at offset if it was the next guess, waiting for them
+     * if need be; got is set to how many there are. They stay put until
+     * the next call. nullptr if the guess was wrong, or there was none.
+     */
+    const unsigned char * take( uulong offset, size_t& got ) {
+      if ( no_slot != _held ) {
+        _free.push_back( _held );
+        _held = no_slot;
+      }
+      if ( _queue.empty( ) || _slots[_queue.front( )].offset != offset ) {
+        _drop( );
+        return nullptr;
+      }
+      _held = _queue.front( );
+      _queue.pop_front( );
+      while ( !_slots[_held].done ) {
+        _complete( );
+      }
+      got = _slots[_held].got;
+      return _slots[_held].buffer.data( );
+    }
+
+  private:
+    static const size_t no_slot = ~size_t( 0 );
+
+    struct slot {
+      uulong offset = 0;
+      size_t got = 0;
+      bool done = false;
+      // the guess was dropped, so the slot is free once the read is done
+      bool dropped = false;
+      std::vector<unsigned char> buffer;
+    };
+
+    void _complete( ) {
+      size_t bytes;
+      slot& sl = _slots[_reader.complete( bytes )];
+      sl.done = true;
+      sl.got = bytes;
+      if ( sl.dropped ) {
+        sl.dropped = false;
+        _free.push_back( &sl - _slots.data( ) );
+      }
+    }
+
+    void _drop( ) {
+      for ( size_t s : _queue ) {
+        if ( _slots[s].done ) {
+          _free.push_back( s );
+        }
+        else {
+          _slots[s].dropped = true;
+        }
+      }
+      _queue.clear( );
+      if ( _free.empty( ) && _reader.in_flight( ) > 0 ) {
+        _complete( );
+      }
+    }
+
+    std::vector<slot> _slots;
+    // declared after the buffers, so outstanding reads finish before they go away
+    async_reader _reader;
+    // the slots of the guesses not taken yet, in file order
+    std::deque<size_t> _queue;
+    std::vector<size_t> _free;
+    // where the guess after the last one queued is
+    uulong _next;
+    uulong _stride;
+    size_t _len;
+    // the slot the last take( ) handed out
+    size_t _held;
+  };
+
+  tdmsfile::tdmsfile( const std::string& filename, const open_options& opts )
+      : _decoded_segments( 0 ), filename( filename ), _opts( opts ), f( nullptr ) {
+
+    if ( opts.memory_map ) {
+      _map.reset( new mapped_file( filename ) );
+      file_contents_size = _map->size( );
+    }
+    else {
+      f = fopen( filename.c_str( ), "rb" );
+      if ( nullptr == f ) {
+        throw std::runtime_error( "File \"" + filename + "\" could not be opened" );
+      }
+      fseek( f, 0, SEEK_END );
+      file_contents_size = ftell( f );
+      fseek( f, 0, SEEK_SET );
     }
-    fseek( f, 0, SEEK_END );
-    file_contents_size = ftell( f );
-    fseek( f, 0, SEEK_SET );
 
     // Now parse the segments
     _parse_segments( );
-    file_contents_size = 0;
   }
 
   void tdmsfile::_parse_segments( ) {
-    uulong offset = 0;
-    size_t maxsegmentsize = 0;
+    bool cached = ( _opts.use_cache && _load_cache( ) );
+    if ( cached ) {
+      log::debug( ) << "loaded parsed metadata from " << _cache_filename( ) << std::endl;
+      _decoded_segments = _segments.size( );
+    }
+    else {
+      if ( !( _opts.use_index && _parse_index( ) ) ) {
+        _scan_segments( );
+      }
+      _catch_up_metadata( );
+    }
+    if ( _opts.use_cache && !cached ) {
+      _decode_metadata( segments( ) );
+      _save_cache( );
+    }
+    _reserve_segbuff( 0 );
+  }
+
+  void tdmsfile::_scan_segments( ) {
+    uulong offset = _end_of_segments( );
+    bool deferred = _defer_metadata( );
+    size_t sampling = std::max<size_t>( _opts.leadin_sampling, 1 );
+    std::unique_ptr<leadin_reader> ahead;
+    if ( _opts.io_queue_depth > 0 && !_map ) {
+      ahead.reset( new leadin_reader( f, _opts.io_queue_depth ) );
+    }
     // First read the metadata of the segments
-    while ( offset < file_contents_size - 8 * 4 ) {
+    while ( offset < file_contents_size ) {
       try {
         auto prev = ( _segments.empty( )
             ? nullptr
             : _segments[_segments.size( ) - 1].get( ) );
 
-        log::debug( ) << "parsing segment " << ( _segments.size( ) + 1 ) << " from offset: " << offset << std::endl;
-        std::unique_ptr<segment> s( new segment( offset, prev, this ) );
+        // when the segment may be more of a run, it's likely to be just a
+        // lead-in; otherwise read its metadata along with the lead-in
+        bool run_head = ( nullptr != prev && !prev->_has( segment::kTocMetaData ) );
+        size_t readahead = ( run_head || deferred ? 0 : segment::_metadata_readahead );
+        if ( ahead && nullptr != prev ) {
+          // guess that the segments from here on are as long as the last
+          // one; when sampling, only the sampled lead-ins are read
+          uulong stride = prev->_next_segment_offset;
+          if ( run_head && sampling > 1 ) {
+            ahead->guess( offset + ( sampling - 1 ) * stride, sampling * stride, 28, file_contents_size );
+          }
+          else {
+            ahead->guess( offset, stride, 28 + readahead, file_contents_size );
+          }
+        }
+
+        if ( run_head ) {
+          uulong more = _repeats( *prev, offset, ahead.get( ) );
+          if ( more > 0 ) {
+            prev->_extend_run( more, !deferred || _decoded_segments == _segments.size( ) );
+            offset += more * prev->_next_segment_offset;
+            continue;
+          }
+        }
 
-        maxsegmentsize = std::max( maxsegmentsize, s->_next_segment_offset );
+        size_t fetched;
+        const unsigned char * leadin = _fetch_leadin( offset, readahead, fetched, ahead.get( ) );
+        if ( run_head && prev->_next_segment_offset <= file_contents_size - offset
+            && prev->_repeated_by( leadin ) ) {
+          prev->_extend_run( 1, !deferred || _decoded_segments == _segments.size( ) );
+          offset += prev->_next_segment_offset;
+          continue;
+        }
+
+        log::debug( ) << "parsing segment " << ( segments( ) + 1 ) << " from offset: " << offset << std::endl;
+        std::unique_ptr<segment> s( new segment( offset, leadin, fetched, prev, this ) );
 
         offset += s->_next_segment_offset;
-        _segments.push_back( std::move( s ) );
+        _append_segment( std::move( s ) );
       }
       catch ( no_segment_error& ) {
         // Last segment was parsed.
         break;
       }
+      catch ( incomplete_segment_error& ) {
+        // the file is still being written (or its writer crashed), so
+        // leave this segment for a later refresh( )
+        log::debug( ) << "segment at offset " << offset << " is incomplete" << std::endl;
+        break;
+      }
+    }
+  }
+
+  uulong tdmsfile::_repeats( const segment& run, uulong offset, leadin_reader * ahead ) {
+    // when sampling, the lead-in n segments on stands for the ones
+    // before it, so if it's more of the run, they all are
+    uulong stride = run._next_segment_offset;
+    uulong fit = ( offset < file_contents_size ? ( file_contents_size - offset ) / stride : 0 );
+    uulong n = std::min<uulong>( std::max<size_t>( _opts.leadin_sampling, 1 ), fit );
+    if ( n < 2 ) {
+      return 0;
+    }
+    uulong pos = offset + ( n - 1 ) * stride;
+    size_t got = 0;
+    const unsigned char * leadin = ( nullptr != ahead ? ahead->take( pos, got ) : nullptr );
+    if ( nullptr == leadin || got < 28 ) {
+      leadin = _fetch( pos, 28, metabuff );
+    }
+    return ( nullptr != leadin && memcmp( leadin, "TDSm", 4 ) == 0 && run._repeated_by( leadin ) ? n : 0 );
+  }
+
+  const unsigned char * tdmsfile::_fetch_leadin( uulong offset, size_t readahead, size_t& fetched,
+      leadin_reader * ahead ) {
+    // the lead-in is 4+4+4+8+8 = 28 bytes
+    fetched = 0;
+    if ( offset < file_contents_size ) {
+      fetched = std::min<uulong>( file_contents_size - offset, 28 + readahead );
+    }
+    if ( fetched < 28 ) {
+      throw no_segment_error( );
+    }
+    size_t got = 0;
+    const unsigned char * leadin = ( nullptr != ahead ? ahead->take( offset, got ) : nullptr );
+    if ( nullptr != leadin && got >= 28 ) {
+      // whatever was read past the lead-in is as good as the readahead
+      fetched = got;
+    }
+    else {
+      leadin = _fetch( offset, fetched, metabuff );
+    }
+    if ( nullptr == leadin || memcmp( leadin, "TDSm", 4 ) != 0 ) {
+      throw no_segment_error( );
+    }
+    return leadin;
+  }
+
+  void tdmsfile::_append_segment( std::unique_ptr<segment> s ) {
+    s->_number = segments( );
+    _segments.push_back( std::move( s ) );
+  }
+
+  size_t tdmsfile::_run_of( size_t segnum ) const {
+    auto it = std::upper_bound( _segments.begin( ), _segments.end( ), segnum,
+        []( size_t n, const std::unique_ptr<segment>& s ) {
+          return n < s->_number;
+        } );
+    return ( it - _segments.begin( ) ) - 1;
+  }
+
+  segment tdmsfile::_segment( size_t segnum ) const {
+    if ( segnum >= segments( ) ) {
+      throw std::out_of_range( "No segment " + std::to_string( segnum ) );
+    }
+    const segment& run = *_segments[_run_of( segnum )];
+    return run._member( segnum - run._number );
+  }
+
+  void tdmsfile::_catch_up_metadata( ) {
+    if ( !_defer_metadata( ) ) {
+      // the segments decoded their metadata as they were read
+      _decoded_segments = _segments.size( );
+    }
+    else if ( !_opts.lazy_metadata ) {
+      _decode_metadata( segments( ) );
+    }
+  }
+
+  void tdmsfile::_reserve_segbuff( size_t first ) {
+    size_t maxsegmentsize = segbuff.size( );
+    for ( size_t i = first; i < _segments.size( ); ++i ) {
+      maxsegmentsize = std::max( maxsegmentsize, _segments[i]->_next_segment_offset );
+    }
+    if ( _buffer_limit( ) > 0 ) {
+      maxsegmentsize = std::min( maxsegmentsize, _buffer_limit( ) );
+    }
+    if ( !_map ) {
+      // memory-mapped files hand out pointers into the mapping instead
+      segbuff.resize( maxsegmentsize );
+    }
+  }
+
+  size_t tdmsfile::_buffer_limit( ) const {
+    return ( _map ? 0 : _opts.max_buffer_size );
+  }
+
+  void tdmsfile::release_buffers( ) {
+    std::vector<unsigned char>( ).swap( segbuff );
+    std::vector<unsigned char>( ).swap( metabuff );
+  }
+
+  uulong tdmsfile::_end_of_segments( ) const {
+    if ( _segments.empty( ) ) {
+      return 0;
+    }
+    const auto& last = _segments[_segments.size( ) - 1];
+    return last->_startpos_in_file + last->_run_length * last->_next_segment_offset;
+  }
+
+  size_t tdmsfile::refresh( ) {
+    size_t newsize;
+    if ( _map ) {
+      std::unique_ptr<mapped_file> remap( new mapped_file( filename ) );
+      newsize = remap->size( );
+      if ( newsize > file_contents_size ) {
+        _map = std::move( remap );
+      }
+    }
+    else {
+      fseek( f, 0, SEEK_END );
+      newsize = ftell( f );
+    }
+    if ( newsize <= file_contents_size && !( newsize == file_contents_size
+        && _end_of_segments( ) < file_contents_size ) ) {
+      return 0;
+    }
+    file_contents_size = newsize;
+
+    size_t first = _segments.size( );
+    size_t first_segment = segments( );
+    _scan_segments( );
+    _catch_up_metadata( );
+    _reserve_segbuff( first );
+    log::debug( ) << "refresh found " << ( segments( ) - first_segment ) << " new segments" << std::endl;
+    return segments( ) - first_segment;
+  }
+
+  bool tdmsfile::_parse_index( ) {
+    // the index holds a copy of every lead-in and all the metadata of
+    // the data file, but no raw data, so one read gets us everything
+    std::vector<unsigned char> index;
+    FILE * idx = fopen( ( filename + "_index" ).c_str( ), "rb" );
+    if ( nullptr == idx ) {
+      return false;
+    }
+    fseek( idx, 0, SEEK_END );
+    index.resize( ftell( idx ) );
+    fseek( idx, 0, SEEK_SET );
+    bool ok = ( fread( index.data( ), 1, index.size( ), idx ) == index.size( ) );
+    fclose( idx );
+    if ( !ok ) {
+      return false;
+    }
+
+    log::debug( ) << "parsing segments from " << filename << "_index" << std::endl;
+    try {
+      uulong idxoffset = 0;
+      uulong offset = 0;
+      std::vector<uulong> leadins;
+      bool deferred = _defer_metadata( );
+      while ( idxoffset + 28 <= index.size( ) ) {
+        const unsigned char * leadin = index.data( ) + idxoffset;
+        if ( memcmp( leadin, "TDSh", 4 ) != 0 ) {
+          throw no_segment_error( );
+        }
+        uulong raw_data_offset = read_as<uint64_t>( leadin + 20, segment::_leadin_endianness( leadin ) );
+        if ( raw_data_offset > index.size( ) - idxoffset - 28 ) {
+          throw read_error( );
+        }
+
+        auto prev = ( _segments.empty( )
+            ? nullptr
+            : _segments[_segments.size( ) - 1].get( ) );
+        if ( nullptr != prev && prev->_repeated_by( leadin ) ) {
+          prev->_extend_run( 1, !deferred || _decoded_segments == _segments.size( ) );
+          idxoffset += 28 + raw_data_offset;
+          offset += prev->_next_segment_offset;
+          continue;
+        }
+        std::unique_ptr<segment> s( new segment( offset, leadin, prev, this ) );
+
+        leadins.push_back( idxoffset );
+        idxoffset += 28 + raw_data_offset;
+        offset += s->_next_segment_offset;
+        _append_segment( std::move( s ) );
+      }
+
+      // the index is only usable if it covers exactly the data file,
+      // and the data file has its segments where the index says
+      if ( idxoffset != index.size( ) || offset != file_contents_size ) {
+        throw read_error( );
+      }
+      if ( !_index_agrees( index, leadins ) ) {
+        throw read_error( );
+      }
+
+      if ( deferred && !_opts.lazy_metadata ) {
+        // all the metadata is in memory already, so decode it from here
+        parallel_for( _segments.size( ), _opts.metadata_threads, [&]( size_t i, unsigned ) {
+          _segments[i]->_decode_metadata( index.data( ) + leadins[i] + 28 );
+        } );
+        _resolve_metadata( _segments.size( ) );
+      }
+    }
+    catch ( std::exception& x ) {
+      log::debug( ) << "index file is unusable (" << x.what( ) << "); scanning data file" << std::endl;
+      _segments.clear( );
+      _channels.clear( );
+      _decoded_segments = 0;
+      return false;
+    }
+    return true;
+  }
+
+  bool tdmsfile::_index_agrees( const std::vector<unsigned char>& index, const std::vector<uulong>& leadins ) {
+    // the lead-ins to check: every entry's own, and those of the runs'
+    // other segments, or every leadin_sampling'th of them and the last
+    struct check {
+      uulong offset;
+      size_t entry;
+      bool member;
+    };
+    std::vector<check> checks;
+    uulong sampling = std::max<size_t>( _opts.leadin_sampling, 1 );
+    for ( size_t e = 0; e < _segments.size( ); ++e ) {
+      const segment& s = *_segments[e];
+      checks.push_back( { s._startpos_in_file, e, false } );
+      for ( uulong k = sampling; k < s._run_length + sampling - 1; k += sampling ) {
+        uulong member = std::min( k, s._run_length - 1 );
+        checks.push_back( { s._startpos_in_file + member * s._next_segment_offset, e, true } );
+      }
+    }
+
+    std::unique_ptr<leadin_reader> ahead;
+    if ( _opts.io_queue_depth > 0 && !_map ) {
+      ahead.reset( new leadin_reader( f, _opts.io_queue_depth ) );
+    }
+    size_t queued = 0;
+    for ( const auto& c : checks ) {
+      while ( ahead && queued < checks.size( ) && ahead->expect( checks[queued].offset, 28 ) ) {
+        ++queued;
+      }
+      size_t got = 0;
+      const unsigned char * leadin = ( ahead ? ahead->take( c.offset, got ) : nullptr );
+      if ( nullptr == leadin || got < 28 ) {
+        leadin = _fetch( c.offset, 28, metabuff );
+      }
+      if ( nullptr == leadin || memcmp( leadin, "TDSm", 4 ) != 0 ) {
+        return false;
+      }
+      if ( c.member
+          ? !_segments[c.entry]->_repeated_by( leadin )
+          : memcmp( leadin + 4, index.data( ) + leadins[c.entry] + 4, 24 ) != 0 ) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  const unsigned char * tdmsfile::_fetch( uulong offset, size_t len, std::vector<unsigned char>& buffer ) {
+    if ( _map ) {
+      if ( offset > _map->size( ) || len > _map->size( ) - offset ) {
+        return nullptr;
+      }
+      return _map->data( ) + offset;
+    }
+
+    if ( buffer.size( ) < len ) {
+      buffer.resize( len );
+    }
+    if ( read_at( f, offset, buffer.data( ), len ) != len ) {
+      return nullptr;
+    }
+    return buffer.data( );
+  }
+
+  const unsigned char * tdmsfile::_fetch( uulong offset, size_t len, std::vector<unsigned char>& buffer,
+      size_t spare, unsigned char *& spare_space ) {
+    // like _fetch( ), but also leaves spare bytes of the buffer free
+    // for the caller (after the data, if it's read into the buffer)
+    size_t needed = ( _map ? spare : len + spare );
+    if ( buffer.size( ) < needed ) {
+      buffer.resize( needed );
+    }
+    if ( _map ) {
+      spare_space = buffer.data( );
+      return _fetch( offset, len, buffer );
+    }
+    spare_space = buffer.data( ) + len;
+    if ( read_at( f, offset, buffer.data( ), len ) != len ) {
+      return nullptr;
+    }
+    return buffer.data( );
+  }
+
+  bool tdmsfile::_defer_metadata( ) const {
+    // segments only read their lead-ins if their metadata is
+    // decoded later, or by several threads at once
+    return ( _opts.lazy_metadata || thread_count( _opts.metadata_threads ) > 1 );
+  }
+
+  void tdmsfile::_decode_metadata( size_t num_segments ) {
+    // the entries those segments are in
+    num_segments = std::min( num_segments, segments( ) );
+    size_t num_runs = ( 0 == num_segments ? 0 : _run_of( num_segments - 1 ) + 1 );
+
+    unsigned threads = thread_count( _opts.metadata_threads );
+    if ( threads > 1 && num_runs > _decoded_segments + 1 ) {
+      // the decoded object lists point into the metadata, so every
+      // segment keeps its own until they've been resolved
+      size_t first = _decoded_segments;
+      std::vector<std::vector<unsigned char>> buffers( num_runs - first );
+      parallel_for( num_runs - first, threads, [&]( size_t i, unsigned ) {
+        auto s = _segments[first + i].get( );
+        s->_decode_metadata( s->_fetch_metadata( buffers[i] ) );
+      } );
+      _resolve_metadata( num_runs );
+      return;
+    }
+
+    for ( ; _decoded_segments < num_runs; ++_decoded_segments ) {
+      auto prev = ( 0 == _decoded_segments
+          ? nullptr
+          : _segments[_decoded_segments - 1].get( ) );
+      _segments[_decoded_segments]->_load_metadata( prev );
+    }
+  }
+
+  void tdmsfile::_resolve_metadata( size_t num_runs ) {
+    // the object lists have been decoded, so all that's left is matching
+    // them up with the channels and earlier segments, in file order
+    for ( ; _decoded_segments < num_runs; ++_decoded_segments ) {
+      auto prev = ( 0 == _decoded_segments
+          ? nullptr
+          : _segments[_decoded_segments - 1].get( ) );
+      _segments[_decoded_segments]->_resolve_metadata( prev );
     }
-    segbuff.reserve( maxsegmentsize );
   }
 
   void tdmsfile::loadSegment( size_t segnum, listener * listener ) {
-    this->_segments[segnum]->_parse_raw_data( listener );
+    _decode_metadata( segnum + 1 );
+    _segment( segnum )._parse_raw_data( listener, segbuff );
+  }
+
+  void tdmsfile::loadSegment( size_t segnum, listener * listener, const std::vector<channel *>& channels ) {
+    _decode_metadata( segnum + 1 );
+    std::set<const channel *> wanted( channels.begin( ), channels.end( ) );
+    _segment( segnum )._parse_channel_data( wanted, listener, segbuff );
+  }
+
+  void tdmsfile::loadChannels( const std::vector<channel *>& channels, listener * listener ) {
+    _decode_metadata( segments( ) );
+    std::set<const channel *> wanted( channels.begin( ), channels.end( ) );
+    for ( auto& run : _segments ) {
+      for ( uulong member = 0; member < run->_run_length; ++member ) {
+        run->_member( member )._parse_channel_data( wanted, listener, segbuff );
+      }
+    }
+  }
+
+  namespace {
+
+    // passes a segment's data on to segment_data()
+    class segment_forwarder : public listener {
+    public:
+
+      segment_forwarder( size_t segnum, listener * target ) : _segnum( segnum ), _target( target ) { }
+
+      virtual void data( const std::string& channelname, const unsigned char* rawdata,
+          data_type_t type, size_t num_vals ) override {
+        _target->segment_data( _segnum, channelname, rawdata, type, num_vals );
+      }
+
+      virtual void string_data( const std::string& channelname, const std::string_view* values,
+          size_t num_vals ) override {
+        _target->segment_string_data( _segnum, channelname, values, num_vals );
+      }
+    private:
+      size_t _segnum;
+      listener * _target;
+    };
+
+    // keeps a segment's data until it's that segment's turn
+    class segment_recorder : public listener {
+    public:
+
+      struct call {
+        const std::string * channelname;
+        const unsigned char * rawdata;
+        data_type_t type;
+        size_t num_vals;
+        // where string values start in strings, for string channels
+        size_t first_string;
+      };
+
+      virtual void data( const std::string& channelname, const unsigned char* rawdata,
+          data_type_t type, size_t num_vals ) override {
+        calls.push_back( call{ &channelname, rawdata, type, num_vals, npos } );
+      }
+
+      virtual void string_data( const std::string& channelname, const std::string_view* values,
+          size_t num_vals ) override {
+        // the views point into the segment's data, which is kept,
+        // but the table they're in gets reused
+        calls.push_back( call{ &channelname, nullptr, data_type_t( ), num_vals, strings.size( ) } );
+        strings.insert( strings.end( ), values, values + num_vals );
+      }
+
+      void replay( listener * target ) {
+        for ( const auto& c : calls ) {
+          if ( npos == c.first_string ) {
+            target->data( *c.channelname, c.rawdata, c.type, c.num_vals );
+          }
+          else {
+            target->string_data( *c.channelname, strings.data( ) + c.first_string, c.num_vals );
+          }
+        }
+        calls.clear( );
+        strings.clear( );
+      }
+
+      static const size_t npos = size_t( -1 );
+      std::vector<call> calls;
+      std::vector<std::string_view> strings;
+    };
+  }
+
+  void tdmsfile::loadSegments( size_t first, size_t last, listener * listener,
+      unsigned threads, bool ordered ) {
+    last = std::min( last, segments( ) );
+    if ( first >= last ) {
+      return;
+    }
+    _decode_metadata( last );
+
+    // the asynchronous reads need whole segments in memory
+    if ( _opts.io_queue_depth > 0 && !_map && 0 == _buffer_limit( ) ) {
+      _load_segments_async( first, last, listener, threads, ordered );
+      return;
+    }
+
+    threads = std::min<size_t>( thread_count( threads ), last - first );
+    std::vector<std::vector<unsigned char>> buffers( threads );
+
+    if ( !ordered ) {
+      parallel_for( last - first, threads, [&]( size_t i, unsigned worker ) {
+        segment_forwarder forwarder( first + i, listener );
+        _segment( first + i )._parse_raw_data( &forwarder, buffers[worker] );
+      } );
+      return;
+    }
+
+    // every worker reads its segment while the others read theirs, then
+    // waits for the segments before it to be delivered before handing
+    // its own to the listener
+    std::vector<segment_recorder> recorders( threads );
+    std::mutex turnlock;
+    std::condition_variable turn;
+    size_t next = first;
+    bool aborted = false;
+
+    parallel_for( last - first, threads, [&]( size_t i, unsigned worker ) {
+      size_t segnum = first + i;
+      segment seg = _segment( segnum );
+      try {
+        // a segment that's read in pieces reuses its buffer for each
+        // piece, so it can't be read until it's its turn
+        bool streamed = seg._streamed( );
+        if ( !streamed ) {
+          seg._parse_raw_data( &recorders[worker], buffers[worker] );
+        }
+
+        std::unique_lock<std::mutex> lock( turnlock );
+        turn.wait( lock, [&]( ) {
+          return ( next == segnum || aborted );
+        } );
+        if ( aborted ) {
+          return;
+        }
+        lock.unlock( );
+
+        if ( streamed ) {
+          seg._parse_raw_data( listener, buffers[worker] );
+        }
+        else {
+          recorders[worker].replay( listener );
+        }
+
+        lock.lock( );
+        ++next;
+      }
+      catch ( ... ) {
+        std::lock_guard<std::mutex> lock( turnlock );
+        aborted = true;
+        recorders[worker].calls.clear( );
+        recorders[worker].strings.clear( );
+        turn.notify_all( );
+        throw;
+      }
+      turn.notify_all( );
+    } );
+  }
+
+  void tdmsfile::_load_segments_async( size_t first, size_t last, listener * listener,
+      unsigned threads, bool ordered ) {
+    // this thread keeps the reads in flight, and hands every segment that
+    // has been read to one of the decoding threads
+
+    struct slot {
+      size_t segnum;
+      std::optional<segment> seg;
+      // the raw data, followed by room for splitting up interleaved data
+      size_t length = 0;
+      std::vector<unsigned char> buffer;
+      segment_recorder recorder;
+    };
+    std::vector<slot> slots( std::max( 1u, _opts.io_queue_depth ) );
+    // declared after the buffers, so outstanding reads finish before they go away
+    async_reader reader( f, slots.size( ) );
+
+    std::mutex lock;
+    std::condition_variable workcv;
+    std::condition_variable freecv;
+    std::vector<size_t> free_slots;
+    for ( size_t i = slots.size( ); i > 0; --i ) {
+      free_slots.push_back( i - 1 );
+    }
+    std::deque<size_t> loaded;
+    std::map<size_t, size_t> ready; // segment number -> slot
+    size_t next = first;
+    bool delivering = false;
+    bool finished = false;
+    std::exception_ptr error;
+
+    auto release = [&]( size_t s ) {
+      free_slots.push_back( s );
+      freecv.notify_one( );
+    };
+
+    auto work = [&]( ) {
+      std::unique_lock<std::mutex> lk( lock );
+      while ( true ) {
+        workcv.wait( lk, [&]( ) {
+          return ( finished || error || !loaded.empty( ) );
+        } );
+        if ( error || loaded.empty( ) ) {
+          return;
+        }
+        size_t s = loaded.front( );
+        loaded.pop_front( );
+        lk.unlock( );
+
+        try {
+          segment * seg = &*slots[s].seg;
+          if ( !ordered ) {
+            segment_forwarder forwarder( slots[s].segnum, listener );
+            seg->_deliver_raw_data( slots[s].buffer.data( ), &forwarder,
+                slots[s].buffer.data( ) + slots[s].length );
+            lk.lock( );
+            release( s );
+            continue;
+          }
+
+          seg->_deliver_raw_data( slots[s].buffer.data( ), &slots[s].recorder,
+              slots[s].buffer.data( ) + slots[s].length );
+          lk.lock( );
+          ready[slots[s].segnum] = s;
+          if ( delivering ) {
+            // whoever is delivering will get to this one
+            continue;
+          }
+          delivering = true;
+          while ( !error && ready.count( next ) ) {
+            size_t r = ready[next];
+            ready.erase( next );
+            lk.unlock( );
+            slots[r].recorder.replay( listener );
+            lk.lock( );
+            ++next;
+            release( r );
+          }
+          delivering = false;
+        }
+        catch ( ... ) {
+          if ( !lk.owns_lock( ) ) {
+            lk.lock( );
+          }
+          if ( !error ) {
+            error = std::current_exception( );
+          }
+          delivering = false;
+          workcv.notify_all( );
+          freecv.notify_all( );
+          return;
+        }
+      }
+    };
+
+    std::vector<std::thread> workers;
+    for ( unsigned t = 0; t < thread_count( threads ); ++t ) {
+      workers.emplace_back( work );
+    }
+
+    try {
+      size_t segnum = first;
+      std::unique_lock<std::mutex> lk( lock );
+      while ( !error ) {
+        while ( segnum < last && !free_slots.empty( ) ) {
+          size_t s = free_slots.back( );
+          free_slots.pop_back( );
+          slots[s].segnum = segnum;
+          segment * seg = &slots[s].seg.emplace( _segment( segnum++ ) );
+          if ( seg->_has_raw_data( ) ) {
+            size_t len = seg->_next_segment_offset - seg->_data_offset;
+            lk.unlock( );
+            slots[s].length = len;
+            slots[s].buffer.resize( len + seg->_columns_size( ) );
+            reader.submit( seg->_startpos_in_file + seg->_data_offset, slots[s].buffer.data( ), len, s );
+            lk.lock( );
+          }
+          else {
+            // nothing to read, but it still has to take its turn
+            loaded.push_back( s );
+            workcv.notify_one( );
+          }
+        }
+
+        if ( reader.in_flight( ) > 0 ) {
+          lk.unlock( );
+          size_t bytes;
+          size_t s = reader.complete( bytes );
+          if ( bytes != slots[s].length ) {
+            throw read_error( );
+          }
+          lk.lock( );
+          loaded.push_back( s );
+          workcv.notify_one( );
+        }
+        else if ( segnum >= last ) {
+          break;
+        }
+        else {
+          freecv.wait( lk, [&]( ) {
+            return ( error || !free_slots.empty( ) );
+          } );
+        }
+      }
+      finished = true;
+      workcv.notify_all( );
+    }
+    catch ( ... ) {
+      std::lock_guard<std::mutex> lk( lock );
+      if ( !error ) {
+        error = std::current_exception( );
+      }
+      workcv.notify_all( );
+    }
+
+    for ( auto& t : workers ) {
+      t.join( );
+    }
+    if ( error ) {
+      std::rethrow_exception( error );
+    }
+  }
+
+  size_t tdmsfile::read( channel * ch, uint64_t start, size_t count, void * out ) {
+    _decode_metadata( segments( ) );
+    if ( ch->_data_type.is_string( ) ) {
+      throw std::runtime_error( "Reading ranges of string data not supported" );
+    }
+    if ( ch->_data_type.is_daqmx( ) ) {
+      throw std::runtime_error( "DAQmx values have to be decoded; read them with channel::read_into" );
+    }
+    size_t value_size = ch->_data_type.length( );
+
+    unsigned char * dest = (unsigned char *) out;
+    size_t done = 0;
+    const data_extent * ext;
+    while ( done < count ) {
+      size_t n = _read_extent( ch, start + done, count - done, dest + done * value_size, ext );
+      if ( 0 == n ) {
+        break;
+      }
+      done += n;
+    }
+    return done;
+  }
+
+  size_t tdmsfile::_read_extent( const channel * ch, uint64_t start, size_t count, unsigned char * out,
+      const data_extent *& ext ) {
+    // find the extent holding the first value
+    const auto& extents = ch->_extents;
+    auto it = std::upper_bound( extents.begin( ), extents.end( ), start,
+        []( uint64_t value, const data_extent& e ) {
+          return value < e.first_value;
+        } );
+    if ( it == extents.begin( ) ) {
+      return 0;
+    }
+    ext = &*--it;
+    segment * seg = ext->seg;
+    size_t value_size = data_type_t( ext->chunk->_stored_type( ) ).length( );
+
+    // chunks are counted through all the extent's segments, which
+    // are a segment apart in the file
+    uint64_t first = start - ext->first_value;
+    uint64_t chunk = first / ext->values_per_chunk;
+    uint64_t within = first % ext->values_per_chunk;
+    uulong datastart = seg->_startpos_in_file + seg->_data_offset;
+    size_t done = 0;
+    for ( ; chunk < ext->num_chunks * ext->segments && done < count; ++chunk, within = 0 ) {
+      size_t n = std::min<uint64_t>( ext->values_per_chunk - within, count - done );
+      uulong member = ext->first_member + chunk / ext->num_chunks;
+      uulong pos = datastart + member * seg->_next_segment_offset
+          + ( chunk % ext->num_chunks ) * ext->chunk_size + ext->offset + within * ext->stride;
+      if ( ext->stride == value_size ) {
+        _read_into( pos, n * value_size, out );
+      }
+      else {
+        // interleaved or DAQmx, so pick the values out of the rows they're in
+        const unsigned char * rows = _fetch( pos, ( n - 1 ) * ext->stride + value_size, segbuff );
+        if ( nullptr == rows ) {
+          throw read_error( );
+        }
+        gather( rows, ext->stride, value_size, n, out );
+      }
+      if ( endianness::BIG == seg->_endianness( ) ) {
+        byteswap( out, value_size, n, out );
+      }
+      out += n * value_size;
+      done += n;
+    }
+    return done;
+  }
+
+  void tdmsfile::_read_into( uulong offset, size_t len, unsigned char * out ) {
+    if ( _map ) {
+      if ( offset > _map->size( ) || len > _map->size( ) - offset ) {
+        throw read_error( );
+      }
+      memcpy( out, _map->data( ) + offset, len );
+    }
+    else if ( read_at( f, offset, out, len ) != len ) {
+      throw read_error( );
+    }
   }
 
   channel * tdmsfile::operator[](const std::string& key ) {
-    return _channelmap.at( key ).get( );
+    _decode_metadata( segments( ) );
+    uint32_t id = _channels.find( key );
+    if ( channel_registry::npos == id ) {
+      throw std::out_of_range( "No channel " + key );
+    }
+    return _channels[id];
   }
 
-  channel * tdmsfile::find_or_make_channel( const std::string& key ) {
-    if ( 0 == _channelmap.count( key ) ) {
-      _channelmap.insert( std::make_pair( key, std::make_unique<channel>( key ) ) );
+  channel * tdmsfile::find_or_make_channel( std::string_view key ) {
+    return _object( key, false );
+  }
+
+  channel * tdmsfile::_object( std::string_view key, bool made_up ) {
+    uint32_t id = _channels.find( key );
+    if ( channel_registry::npos != id ) {
+      if ( !made_up ) {
+        _channels[id]->_made_up = false;
+      }
+      return _channels[id];
+    }
+
+    std::vector<std::string> names;
+    channel * parent = nullptr;
+    std::string name;
+    if ( !split_path( key, names ) ) {
+      log::debug( ) << "object path " << key << " can't be split up" << std::endl;
+      name = key;
+    }
+    else if ( !names.empty( ) ) {
+      // the parent is made first, so parents come before their children
+      name = std::move( names.back( ) );
+      names.pop_back( );
+      parent = _object( object_path( names ), true );
+    }
+
+    auto c = std::make_unique<channel>( std::string( key ) );
+    c->_file = this;
+    c->_id = _channels.size( );
+    c->_name = std::move( name );
+    c->_parent = parent;
+    c->_made_up = made_up;
+    if ( nullptr != parent ) {
+      parent->_children.push_back( c.get( ) );
     }
-    return _channelmap.at( key ).get( );
+    return _channels[_channels.add( std::move( c ) )];
   }
 
+  channel * tdmsfile::find_object( std::string_view path ) {
+    _decode_metadata( segments( ) );
+    uint32_t id = _channels.find( path );
+    return ( channel_registry::npos == id ? nullptr : _channels[id] );
+  }
+
+  channel * tdmsfile::root( ) {
+    return find_object( "/" );
+  }
+
+  const std::vector<channel *>& tdmsfile::groups( ) {
+    static const std::vector<channel *> none;
+    channel * r = root( );
+    return ( nullptr == r ? none : r->children( ) );
+  }
+
+  channel * tdmsfile::find_group( const std::string& name ) {
+    return find_object( child_path( "/", name ) );
+  }
+
+  channel * tdmsfile::find_channel( const std::string& group, const std::string& name ) {
+    return find_object( child_path( child_path( "/", group ), name ) );
+  }
+
+  channel * channel::child( const std::string& name ) const {
+    return _file->find_object( child_path( _path, name ) );
+  }
+
+  size_t tdmsfile::channel_count( ) {
+    _decode_metadata( segments( ) );
+    return _channels.size( );
+  }
+
+  channel * tdmsfile::channel_by_id( uint32_t id ) {
+    _decode_metadata( segments( ) );
+    if ( id >= _channels.size( ) ) {
+      throw std::out_of_range( "No channel " + std::to_string( id ) );
+    }
+    return _channels[id];
+  }
+
+
   tdmsfile::~tdmsfile( ) {
-    fclose( f );
+    if ( nullptr != f ) {
+      fclose( f );
+    }
   }
 
-  channel::channel( const std::string& path ) : _path( path ), _has_data( false ),
+  channel::channel( const std::string& path ) : _file( nullptr ), _path( path ), _id( 0 ),
+      _parent( nullptr ), _made_up( false ), _has_data( false ),
       _data_start( 0 ), _number_values( 0 ) { }
 
+  size_t channel::_read_values( uint64_t start, size_t count, void * out, uint32_t as, bool scaled ) {
+    if ( nullptr == _file ) {
+      throw std::runtime_error( "Channel " + _path + " doesn't belong to a file" );
+    }
+    if ( _data_type.is_daqmx( ) ) {
+      // segments can store them differently, so they're converted (and
+      // scaled) an extent's worth at a time, from only the rows they're in
+      _file->_decode_metadata( _file->segments( ) );
+      const size_t block = 4096;
+      std::vector<unsigned char> stored( block * sizeof ( uint64_t ) );
+      unsigned char * dest = (unsigned char *) out;
+      size_t size = data_type_t::from_code( as ).ctype_length( );
+      size_t done = 0;
+      const data_extent * ext;
+      while ( done < count ) {
+        size_t n = _file->_read_extent( this, start + done, std::min( block, count - done ), stored.data( ), ext );
+        if ( 0 == n ) {
+          break;
+        }
+        const daqmx_scaler& scaler = ext->chunk->_daqmx_scaler( );
+        if ( scaler.bit >= 0 ) {
+          // digital lines are 0 or 1, and never scaled
+          for ( size_t i = 0; i < n; ++i ) {
+            stored[i] = ( stored[i] >> scaler.bit ) & 1;
+          }
+          convert( stored.data( ), tdsTypeU8, n, dest + done * size, as );
+        }
+        else {
+          convert( stored.data( ), scaler.data_type, n, dest + done * size, as,
+              ( scaled ? ext->chunk->_scaling.get( ) : nullptr ) );
+        }
+        done += n;
+      }
+      return done;
+    }
+
+    uint32_t from = _data_type.code( );
+    std::shared_ptr<const scaling> scale;
+    if ( scaled ) {
+      scale = scaling::from_properties( _properties );
+    }
+    if ( from != as && !is_convertible( from, as ) ) {
+      throw std::runtime_error( "Channel " + _path + " has " + _data_type.name( ) + " values, not "
+          + data_type_t::from_code( as ).name( ) );
+    }
+    if ( from == as && !scale && _data_type.length( ) == _data_type.ctype_length( ) ) {
+      return _file->read( this, start, count, out );
+    }
+
+    // the rest are converted as they're read, a block at a time
+    const size_t block = 4096;
+    std::vector<unsigned char> stored( block * _data_type.length( ) );
+    unsigned char * dest = (unsigned char *) out;
+    size_t size = data_type_t::from_code( as ).ctype_length( );
+    size_t done = 0;
+    while ( done < count ) {
+      size_t n = _file->read( this, start + done, std::min( block, count - done ), stored.data( ) );
+      if ( 0 == n ) {
+        break;
+      }
+      convert( stored.data( ), from, n, dest + done * size, as, scale.get( ) );
+      done += n;
+    }
+    return done;
+  }
+
   channel::~channel( ) { };
 
   channel::property::~property( ) {
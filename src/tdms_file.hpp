@@ -10,73 +10,271 @@
 
 #include "tdms_exports.h"
 #include "tdms_segment.hpp"
+#include "tdms_io.hpp"
+#include "channel_registry.hpp"
+#include "object_path.hpp"
 
 namespace TDMS {
 
   class segment;
   class datachunk;
   class channel;
+  class leadin_reader;
+
+  struct open_options {
+    // map the whole file into memory and hand out pointers into the mapping
+    // instead of reading segments through stdio
+    bool memory_map = false;
+    // build the segment list from the .tdms_index file next to the data
+    // file, if it exists and agrees with the data file. Every lead-in in
+    // the data file is checked against the index (only every
+    // leadin_sampling'th in runs), which is one small read per segment,
+    // but saves reading the metadata from all over the data file.
+    bool use_index = true;
+    // keep a snapshot of the parsed metadata and load it instead of parsing
+    // the file again, as long as the file's size and modification time match
+    bool use_cache = false;
+    // where to keep the snapshots; next to the file when empty
+    std::string cache_directory;
+    // only read the segment lead-ins when opening the file; object lists
+    // and properties are decoded when a segment is loaded (for that
+    // segment and everything before it) or a channel is looked up (for
+    // the whole file)
+    bool lazy_metadata = false;
+    // runs of segments without metadata that are laid out alike are
+    // kept as one entry; when scanning a file for such a run (or checking
+    // one against the index), only the lead-in of every nth segment is
+    // read, and the ones in between are taken to be the same as the rest
+    // of the run. 1 reads them all.
+    size_t leadin_sampling = 1;
+    // how many threads decode segment metadata once the lead-ins have been
+    // read; 0 means one per core
+    unsigned metadata_threads = 1;
+    // how many segment reads loadSegments( ) keeps in flight (through
+    // io_uring where available); 0 reads each segment with a blocking read
+    // on the thread that decodes it. Scanning the file for segments keeps
+    // as many reads of the lead-ins it expects next in flight.
+    unsigned io_queue_depth = 0;
+    // the most raw data (in bytes) read into memory at once; bigger segments
+    // are read and handed to listeners in pieces of whole chunks, or of
+    // whole values when one chunk is bigger than this. 0 reads every
+    // segment in one go. Memory-mapped files don't need the buffers.
+    size_t max_buffer_size = 0;
+  };
 
   class tdmsfile {
     friend class segment;
+    friend class prefetching_loader;
+    friend class channel;
   public:
-      TDMS_EXPORT tdmsfile( const std::string& filename );
+      TDMS_EXPORT tdmsfile( const std::string& filename, const open_options& opts = open_options( ) );
       TDMS_EXPORT tdmsfile& operator=(const tdmsfile&) = delete;
       TDMS_EXPORT tdmsfile( const tdmsfile& ) = delete;
       TDMS_EXPORT virtual ~tdmsfile( );
 
       TDMS_EXPORT channel * operator[](const std::string& key );
-      TDMS_EXPORT channel *  find_or_make_channel( const std::string& key );
+      TDMS_EXPORT channel *  find_or_make_channel( std::string_view key );
+
+      /**
+       * The number of objects in the file, made-up parents included.
+       * Their IDs run from 0 to one less than this, in the order the file
+       * first mentions them.
+       */
+      TDMS_EXPORT size_t channel_count( );
+
+      TDMS_EXPORT channel * channel_by_id( uint32_t id );
+
+      /**
+       * The object with the given path, or nullptr
+       */
+      TDMS_EXPORT channel * find_object( std::string_view path );
+
+      /**
+       * The file's own object ("/"), which the groups are the children
+       * of, or nullptr if the file has no objects. Objects whose parents
+       * the file doesn't mention get ones made up for them (see
+       * channel::made_up), so every group and channel is in the tree.
+       */
+      TDMS_EXPORT channel * root( );
+
+      /**
+       * The groups, in the order the file first mentions them
+       */
+      TDMS_EXPORT const std::vector<channel *>& groups( );
+
+      /**
+       * The group with the given name, or nullptr
+       */
+      TDMS_EXPORT channel * find_group( const std::string& name );
+
+      /**
+       * The channel with the given name in the named group, or nullptr
+       */
+      TDMS_EXPORT channel * find_channel( const std::string& group, const std::string& name );
 
       TDMS_EXPORT const size_t segments( ) const {
-      return _segments.size( );
+      return ( _segments.empty( )
+          ? 0
+          : _segments.back( )->_number + _segments.back( )->_run_length );
     }
 
       TDMS_EXPORT void loadSegment( size_t segnum, listener * );
 
+      /**
+       * Loads only the given channels' data from the segment, reading
+       * just the parts of the segment those channels are in
+       */
+      TDMS_EXPORT void loadSegment( size_t segnum, listener *, const std::vector<channel *>& channels );
+
+      /**
+       * Loads the given channels' data from every segment. Like
+       * loadSegment, it keeps its buffers for the next load (see
+       * release_buffers).
+       */
+      TDMS_EXPORT void loadChannels( const std::vector<channel *>& channels, listener * );
+
+      /**
+       * Frees the buffers used for loading segments. They're allocated
+       * again when needed
+       */
+      TDMS_EXPORT void release_buffers( );
+
+      /**
+       * Picks up segments appended to the file since it was opened (or
+       * last refreshed), and adds their values to the channels. A segment
+       * that is still being written is left for a later refresh. Returns
+       * the number of new segments. Memory-mapped files are mapped again
+       * if they grew, so data pointers handed out earlier become invalid.
+       * Don't call this while segments are being loaded.
+       */
+      TDMS_EXPORT size_t refresh( );
+
+      /**
+       * Reads count of the channel's values, starting at value number
+       * start, into out (which must hold count * bytes per value),
+       * reading only the bytes those values take up in the file. Returns
+       * the number of values read, which is less than count only if the
+       * channel ends first.
+       */
+      TDMS_EXPORT size_t read( channel * ch, uint64_t start, size_t count, void * out );
+
+      /**
+       * Loads segments [first, last) on up to the given number of threads
+       * (0 means one per core), each with its own buffer. If ordered, the
+       * listener's data() sees the segments in file order, one at a time;
+       * otherwise, segment_data() is called from the loading threads as
+       * each segment finishes, so the listener must be thread-safe.
+       */
+      TDMS_EXPORT void loadSegments( size_t first, size_t last, listener *,
+          unsigned threads = 0, bool ordered = true );
+
     class iterator {
       friend class tdmsfile;
     public:
 
         TDMS_EXPORT channel * operator*( ) {
-        return _it->second.get( );
+        return ( *_channels )[_id];
       }
 
         TDMS_EXPORT const iterator& operator++( ) {
-        ++_it;
-
+        ++_id;
+        _skip_made_up( );
         return *this;
       }
 
         TDMS_EXPORT bool operator!=(const iterator& other ) {
-        return other._it != _it;
+        return other._id != _id;
       }
     private:
 
-      iterator( std::map<std::string, std::unique_ptr<channel>>::iterator it )
-          : _it( it ) { }
-      std::map<std::string, std::unique_ptr<channel>>::iterator _it;
+      iterator( const channel_registry * channels, uint32_t id )
+          : _channels( channels ), _id( id ) {
+        _skip_made_up( );
+      }
+
+      void _skip_made_up( ) {
+        while ( _id < _channels->size( ) && ( *_channels )[_id]->made_up( ) ) {
+          ++_id;
+        }
+      }
+
+      const channel_registry * _channels;
+      uint32_t _id;
     };
 
+    // the objects the file mentions, in the order it first mentions them;
+    // made-up parents are left out
     iterator begin( ) {
-      return iterator( _channelmap.begin( ) );
+      _decode_metadata( segments( ) );
+      return iterator( &_channels, 0 );
     }
 
     iterator end( ) {
-      return iterator( _channelmap.end( ) );
+      _decode_metadata( segments( ) );
+      return iterator( &_channels, _channels.size( ) );
     }
 
   private:
+    // the object with the path, made if it's new; made_up says whether
+    // the file mentions it itself or it's only the parent of one it does
+    channel * _object( std::string_view key, bool made_up );
     void _parse_segments();
+    void _scan_segments( );
+    // how many segments from offset on are more of the run, going by a
+    // sampled lead-in further on; 0 if there isn't one, or it isn't
+    uulong _repeats( const segment& run, uulong offset, leadin_reader * ahead );
+    // the lead-in at offset, with up to readahead bytes after it (so the
+    // metadata can come in with the same read); fetched is set to the
+    // number of bytes there. ahead may have read it already. Throws
+    // no_segment_error if there's no segment there.
+    const unsigned char * _fetch_leadin( uulong offset, size_t readahead, size_t& fetched,
+        leadin_reader * ahead = nullptr );
+    void _append_segment( std::unique_ptr<segment> s );
+    // which entry of _segments segment number segnum is in
+    size_t _run_of( size_t segnum ) const;
+    segment _segment( size_t segnum ) const;
+    void _catch_up_metadata( );
+    void _reserve_segbuff( size_t first );
+    uulong _end_of_segments( ) const;
+    bool _parse_index( );
+    // whether the data file has the lead-ins the index says it has;
+    // leadins are where the entries of _segments are in the index
+    bool _index_agrees( const std::vector<unsigned char>& index, const std::vector<uulong>& leadins );
+    TDMS_EXPORT void _decode_metadata( size_t num_segments );
+    bool _defer_metadata( ) const;
+    size_t _buffer_limit( ) const;
+    void _resolve_metadata( size_t num_runs );
+    void _load_segments_async( size_t first, size_t last, listener *,
+        unsigned threads, bool ordered );
+    std::string _cache_filename( ) const;
+    bool _load_cache( );
+    void _save_cache( );
+    const unsigned char * _fetch( uulong offset, size_t len, std::vector<unsigned char>& buffer );
+    const unsigned char * _fetch( uulong offset, size_t len, std::vector<unsigned char>& buffer,
+        size_t spare, unsigned char *& spare_space );
+    void _read_into( uulong offset, size_t len, unsigned char * out );
+    // reads up to count of ch's values from value number start on, as
+    // they're stored, stopping at the end of the extent start is in,
+    // which ext is set to. Returns how many were read, 0 past the end.
+    size_t _read_extent( const channel * ch, uint64_t start, size_t count, unsigned char * out,
+        const data_extent *& ext );
 
     size_t file_contents_size;
+    // the segments, in file order, with every run of segments that only
+    // differ in where they start kept as one entry
     std::vector<std::unique_ptr<segment>> _segments;
+    // how many entries of _segments (from the start) have their metadata decoded
+    size_t _decoded_segments;
     std::string filename;
+    open_options _opts;
     FILE * f;
+    std::unique_ptr<mapped_file> _map;
 
-    std::map<std::string, std::unique_ptr<channel>> _channelmap;
+    channel_registry _channels;
 
     // a memory buffer for loading segment data
     std::vector<unsigned char> segbuff;
+    // a memory buffer for loading lead-ins and metadata
+    std::vector<unsigned char> metabuff;
   };
 }
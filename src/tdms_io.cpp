@@ -0,0 +1,150 @@
+#include <stdexcept>
+#include <algorithm>
+#include <cerrno>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#include <io.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "tdms_io.hpp"
+
+namespace TDMS{
+
+#if defined(_WIN32)
+
+  size_t read_at( FILE * f, unsigned long long offset, void * buffer, size_t len ) {
+    HANDLE h = (HANDLE) _get_osfhandle( _fileno( f ) );
+    size_t total = 0;
+    while ( total < len ) {
+      OVERLAPPED ov = { };
+      ov.Offset = (DWORD) ( ( offset + total ) & 0xFFFFFFFF );
+      ov.OffsetHigh = (DWORD) ( ( offset + total ) >> 32 );
+      DWORD chunk = (DWORD) std::min<size_t>( len - total, 0x40000000 );
+      DWORD got = 0;
+      if ( !ReadFile( h, (char *) buffer + total, chunk, &got, &ov ) || 0 == got ) {
+        break;
+      }
+      total += got;
+    }
+    return total;
+  }
+
+  mapped_file::mapped_file( const std::string& filename ) : _data( nullptr ), _size( 0 ),
+      _file_handle( INVALID_HANDLE_VALUE ), _mapping_handle( nullptr ) {
+    _file_handle = CreateFileA( filename.c_str( ), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+        nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+    if ( INVALID_HANDLE_VALUE == _file_handle ) {
+      throw std::runtime_error( "File \"" + filename + "\" could not be opened" );
+    }
+
+    LARGE_INTEGER size;
+    if ( !GetFileSizeEx( _file_handle, &size ) ) {
+      CloseHandle( _file_handle );
+      throw std::runtime_error( "File \"" + filename + "\" could not be sized" );
+    }
+    _size = (size_t) size.QuadPart;
+    if ( 0 == _size ) {
+      // empty files can't be mapped, but there's nothing to read anyway
+      return;
+    }
+
+    _mapping_handle = CreateFileMappingA( _file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr );
+    if ( nullptr == _mapping_handle ) {
+      CloseHandle( _file_handle );
+      throw std::runtime_error( "File \"" + filename + "\" could not be mapped" );
+    }
+    _data = (const unsigned char *) MapViewOfFile( _mapping_handle, FILE_MAP_READ, 0, 0, 0 );
+    if ( nullptr == _data ) {
+      CloseHandle( _mapping_handle );
+      CloseHandle( _file_handle );
+      throw std::runtime_error( "File \"" + filename + "\" could not be mapped" );
+    }
+  }
+
+  void mapped_file::prefetch( size_t /*offset*/, size_t /*len*/ ) const {
+    // PrefetchVirtualMemory isn't available everywhere, so leave it to the OS
+  }
+
+  mapped_file::~mapped_file( ) {
+    if ( nullptr != _data ) {
+      UnmapViewOfFile( _data );
+    }
+    if ( nullptr != _mapping_handle ) {
+      CloseHandle( _mapping_handle );
+    }
+    if ( INVALID_HANDLE_VALUE != _file_handle ) {
+      CloseHandle( _file_handle );
+    }
+  }
+
+#else
+
+  size_t read_at( FILE * f, unsigned long long offset, void * buffer, size_t len ) {
+    int fd = fileno( f );
+    size_t total = 0;
+    while ( total < len ) {
+      ssize_t got = pread( fd, (char *) buffer + total, len - total, offset + total );
+      if ( got < 0 && EINTR == errno ) {
+        continue;
+      }
+      if ( got <= 0 ) {
+        break;
+      }
+      total += got;
+    }
+    return total;
+  }
+
+  mapped_file::mapped_file( const std::string& filename ) : _data( nullptr ), _size( 0 ) {
+    int fd = open( filename.c_str( ), O_RDONLY );
+    if ( fd < 0 ) {
+      throw std::runtime_error( "File \"" + filename + "\" could not be opened" );
+    }
+
+    struct stat st;
+    if ( 0 != fstat( fd, &st ) ) {
+      close( fd );
+      throw std::runtime_error( "File \"" + filename + "\" could not be sized" );
+    }
+    _size = (size_t) st.st_size;
+    if ( 0 == _size ) {
+      // empty files can't be mapped, but there's nothing to read anyway
+      close( fd );
+      return;
+    }
+
+    void * addr = mmap( nullptr, _size, PROT_READ, MAP_SHARED, fd, 0 );
+    // the mapping keeps its own reference to the file
+    close( fd );
+    if ( MAP_FAILED == addr ) {
+      throw std::runtime_error( "File \"" + filename + "\" could not be mapped" );
+    }
+    _data = (const unsigned char *) addr;
+  }
+
+  void mapped_file::prefetch( size_t offset, size_t len ) const {
+    if ( nullptr == _data || offset >= _size ) {
+      return;
+    }
+    // madvise wants a page-aligned start
+    size_t page = (size_t) sysconf( _SC_PAGESIZE );
+    size_t start = offset - ( offset % page );
+    len = std::min( len + ( offset - start ), _size - start );
+    posix_madvise( (void *) ( _data + start ), len, POSIX_MADV_WILLNEED );
+  }
+
+  mapped_file::~mapped_file( ) {
+    if ( nullptr != _data ) {
+      munmap( (void *) _data, _size );
+    }
+  }
+
+#endif
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <string>
+#include <cstddef>
+#include <cstdio>
+
+#include "tdms_exports.h"
+
+namespace TDMS {
+
+  /**
+   * Reads up to len bytes at the given offset of the file without using
+   * (or moving) the stream's file position, so any number of threads can
+   * read from the same file at once. Returns the number of bytes read.
+   */
+  TDMS_EXPORT size_t read_at( FILE * f, unsigned long long offset, void * buffer, size_t len );
+
+  /**
+   * A read-only mapping of a whole file into memory. Pointers returned by
+   * data() stay valid for the lifetime of the mapping.
+   */
+  class mapped_file {
+  public:
+    TDMS_EXPORT mapped_file( const std::string& filename );
+    TDMS_EXPORT mapped_file( const mapped_file& ) = delete;
+    TDMS_EXPORT mapped_file& operator=(const mapped_file&) = delete;
+    TDMS_EXPORT virtual ~mapped_file( );
+
+    TDMS_EXPORT const unsigned char * data( ) const {
+      return _data;
+    }
+
+    TDMS_EXPORT size_t size( ) const {
+      return _size;
+    }
+
+    /**
+     * Lets the OS know the given range will be read soon.
+     */
+    TDMS_EXPORT void prefetch( size_t offset, size_t len ) const;
+
+  private:
+    const unsigned char * _data;
+    size_t _size;
+#if defined(_WIN32)
+    void * _file_handle;
+    void * _mapping_handle;
+#endif
+  };
+}
@@ -16,6 +16,7 @@
 
 #include "data_type.h"
 #include <string>
+#include <string_view>
 
 namespace TDMS {
 
@@ -23,6 +24,32 @@ namespace TDMS {
   public:
     virtual void data( const std::string& channelname, const unsigned char* rawdata,
         data_type_t, size_t num_vals ) = 0;
+
+    /**
+     * Called instead of data() when tdmsfile::loadSegments() delivers
+     * segments as they finish loading, rather than in file order. Calls
+     * come from several threads at once.
+     */
+    virtual void segment_data( size_t /*segnum*/, const std::string& channelname,
+        const unsigned char* rawdata, data_type_t type, size_t num_vals ) {
+      data( channelname, rawdata, type, num_vals );
+    }
+
+    /**
+     * Called instead of data() for string channels. Like the raw data
+     * passed to data(), the views (and the characters they point to) are
+     * only valid until this call returns, so copy anything to be kept.
+     */
+    virtual void string_data( const std::string& /*channelname*/, const std::string_view* /*values*/,
+        size_t /*num_vals*/ ) { }
+
+    /**
+     * The string_data() counterpart of segment_data().
+     */
+    virtual void segment_string_data( size_t /*segnum*/, const std::string& channelname,
+        const std::string_view* values, size_t num_vals ) {
+      string_data( channelname, values, num_vals );
+    }
   };
 
 }
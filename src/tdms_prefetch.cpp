@@ -0,0 +1,154 @@
+#include <algorithm>
+
+#include "tdms_prefetch.hpp"
+#include "tdms_file.hpp"
+#include "tdms_segment.hpp"
+#include "tdms_exceptions.h"
+
+namespace TDMS{
+
+  prefetching_loader::prefetching_loader( tdmsfile& file, size_t readahead_segments,
+      size_t readahead_bytes ) : _file( file ), _next( 0 ), _readahead_bytes( readahead_bytes ),
+      _buffered_bytes( 0 ), _decoded( 0 ), _stopping( false ) {
+    // one buffer for the segment being delivered, and the rest for reading ahead
+    _slots.resize( std::max<size_t>( readahead_segments, 1 ) + 1 );
+    for ( size_t i = _slots.size( ); i > 0; --i ) {
+      _free.push_back( i - 1 );
+    }
+    _decode_ahead( );
+    _reader = std::thread( [this]( ) {
+      _read_ahead( );
+    } );
+  }
+
+  prefetching_loader::~prefetching_loader( ) {
+    {
+      std::lock_guard<std::mutex> lock( _lock );
+      _stopping = true;
+    }
+    _writable.notify_all( );
+    _reader.join( );
+  }
+
+  void prefetching_loader::_decode_ahead( ) {
+    // the reader can be as many segments ahead as there are slots
+    size_t decoded = std::min( _next + _slots.size( ), _file.segments( ) );
+    _file._decode_metadata( decoded );
+    {
+      std::lock_guard<std::mutex> lock( _lock );
+      _decoded = decoded;
+    }
+    _writable.notify_all( );
+  }
+
+  void prefetching_loader::_read_ahead( ) {
+    std::unique_lock<std::mutex> lock( _lock );
+    for ( size_t segnum = _next; segnum < _file.segments( ); ++segnum ) {
+      // how much room a segment needs depends on its metadata, which is
+      // decoded on the thread calling next( ), so wait for that
+      _writable.wait( lock, [&]( ) {
+        return _stopping || segnum < _decoded;
+      } );
+      if ( _stopping ) {
+        return;
+      }
+
+      // the run the segment is in, which it's laid out like
+      segment * seg = _file._segments[_file._run_of( segnum )].get( );
+      bool streamed = seg->_streamed( );
+      size_t size = ( seg->_has_raw_data( ) && !streamed
+          ? seg->_next_segment_offset - seg->_data_offset
+          : 0 );
+
+      _writable.wait( lock, [&]( ) {
+        return _stopping || ( !_free.empty( ) && ( 0 == _readahead_bytes || 0 == _buffered_bytes
+            || _buffered_bytes + size <= _readahead_bytes ) );
+      } );
+      if ( _stopping ) {
+        return;
+      }
+      size_t s = _free.back( );
+      _free.pop_back( );
+      _buffered_bytes += size;
+      lock.unlock( );
+
+      slot& sl = _slots[s];
+      sl.segnum = segnum;
+      sl.size = size;
+      sl.data = nullptr;
+      sl.streamed = streamed;
+      try {
+        if ( size > 0 ) {
+          uulong start = seg->_startpos_in_file + ( segnum - seg->_number ) * seg->_next_segment_offset
+              + seg->_data_offset;
+          if ( _file._map ) {
+            _file._map->prefetch( start, size );
+          }
+          sl.data = _file._fetch( start, size, sl.buffer, seg->_columns_size( ), sl.columns );
+          if ( nullptr == sl.data ) {
+            throw read_error( );
+          }
+        }
+      }
+      catch ( ... ) {
+        lock.lock( );
+        _error = std::current_exception( );
+        _readable.notify_all( );
+        return;
+      }
+
+      lock.lock( );
+      _filled.push_back( s );
+      _readable.notify_all( );
+    }
+  }
+
+  bool prefetching_loader::next( listener * listener ) {
+    if ( _next >= _file.segments( ) ) {
+      return false;
+    }
+    _decode_ahead( );
+
+    std::unique_lock<std::mutex> lock( _lock );
+    _readable.wait( lock, [this]( ) {
+      return ( _error || !_filled.empty( ) );
+    } );
+    if ( _filled.empty( ) ) {
+      std::rethrow_exception( _error );
+    }
+    size_t s = _filled.front( );
+    _filled.pop_front( );
+    lock.unlock( );
+
+    auto release = [&]( ) {
+      lock.lock( );
+      _buffered_bytes -= _slots[s].size;
+      _free.push_back( s );
+      ++_next;
+      lock.unlock( );
+      _writable.notify_all( );
+    };
+
+    try {
+      segment seg = _file._segment( _slots[s].segnum );
+      if ( _slots[s].streamed ) {
+        seg._parse_raw_data( listener, _slots[s].buffer );
+      }
+      else {
+        seg._deliver_raw_data( _slots[s].data, listener, _slots[s].columns );
+      }
+    }
+    catch ( ... ) {
+      release( );
+      throw;
+    }
+    release( );
+    return true;
+  }
+
+  void prefetching_loader::load_all( listener * listener ) {
+    while ( next( listener ) ) {
+      // keep going
+    }
+  }
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <exception>
+
+#include "tdms_exports.h"
+#include "tdms_listener.h"
+
+namespace TDMS {
+
+  class tdmsfile;
+
+  /**
+   * Loads a file's segments in order, while a background thread reads the
+   * next few segments into a set of rotating buffers. This overlaps the
+   * reading with whatever the listener does with the data, without the
+   * caller having to manage any threads.
+   */
+  class prefetching_loader {
+  public:
+    /**
+     * Reads ahead by up to readahead_segments segments, and (if
+     * readahead_bytes isn't 0) by no more than readahead_bytes bytes,
+     * though always by at least one segment. Segments bigger than the
+     * file's max_buffer_size aren't read ahead; next() reads them in
+     * pieces instead.
+     */
+    TDMS_EXPORT prefetching_loader( tdmsfile& file, size_t readahead_segments = 2,
+        size_t readahead_bytes = 0 );
+    TDMS_EXPORT prefetching_loader( const prefetching_loader& ) = delete;
+    TDMS_EXPORT prefetching_loader& operator=(const prefetching_loader&) = delete;
+    TDMS_EXPORT virtual ~prefetching_loader( );
+
+    /**
+     * Hands the next segment to the listener, and returns false if there
+     * are no segments left.
+     */
+    TDMS_EXPORT bool next( listener * );
+
+    /**
+     * Hands all the remaining segments to the listener.
+     */
+    TDMS_EXPORT void load_all( listener * );
+
+    /**
+     * The number of the segment next() will load.
+     */
+    TDMS_EXPORT size_t position( ) const {
+      return _next;
+    }
+
+  private:
+    // decodes the metadata of every segment the reader may get to
+    // before next( ) is called again
+    void _decode_ahead( );
+    void _read_ahead( );
+
+    struct slot {
+      size_t segnum;
+      size_t size;
+      const unsigned char * data;
+      // where interleaved data gets split into channels
+      unsigned char * columns;
+      // read in pieces by next( ), instead of ahead of time
+      bool streamed;
+      std::vector<unsigned char> buffer;
+    };
+
+    tdmsfile& _file;
+    size_t _next;
+    size_t _readahead_bytes;
+    size_t _buffered_bytes;
+    // how many segments (from the start) the reader may read, having had
+    // their metadata decoded
+    size_t _decoded;
+    bool _stopping;
+    std::exception_ptr _error;
+    std::vector<slot> _slots;
+    std::vector<size_t> _free;
+    std::deque<size_t> _filled;
+    std::mutex _lock;
+    std::condition_variable _readable;
+    std::condition_variable _writable;
+    std::thread _reader;
+  };
+}
@@ -10,55 +10,81 @@
 #include "tdms_segment.hpp"
 #include "log.hpp"
 #include "data_extraction.hpp"
+#include "data_kernels.hpp"
+#include "data_scaling.hpp"
 #include "tdms_exceptions.h"
 #include "data_type.h"
 #include "tdms_channel.h"
 
 namespace TDMS{
 
-  const std::map<const std::string, int32_t> segment::_toc_properties = {
-    {"kTocMetaData", int32_t( 1 ) << 1 },
-    {"kTocRawData", int32_t( 1 ) << 3 },
-    {"kTocDAQmxRawData", int32_t( 1 ) << 7 },
-    {"kTocInterleavedData", int32_t( 1 ) << 5 },
-    {"kTocBigEndian", int32_t( 1 ) << 6 },
-    {"kTocNewObjList", int32_t( 1 ) << 2 }
-  };
+  namespace {
 
-  segment::segment( uulong segment_start, segment * previous_segment, tdmsfile * file )
-      : _startpos_in_file( segment_start ), _parent_file( file ) {
+    // what segments hold before their metadata has been resolved
+    const std::shared_ptr<const std::vector<datachunk>>& no_chunks( ) {
+      static const auto empty = std::make_shared<const std::vector<datachunk>>( );
+      return empty;
+    }
+  }
 
-    fseek( file->f, segment_start, SEEK_SET );
+  segment::segment( uulong segment_start, segment * previous_segment, tdmsfile * file )
+      : segment( segment_start, file ) {
+    size_t fetched;
+    // read a little more than the lead-in, so the metadata usually comes
+    // in with the same read
+    const unsigned char * leadin = file->_fetch_leadin( segment_start, _metadata_readahead, fetched );
+    _read_fetched( leadin, fetched, previous_segment );
+  }
 
-    unsigned char justread[8]; // biggest element we'll read here
-    auto ok = fread( justread, sizeof ( char ), 4, file->f );
+  segment::segment( uulong segment_start, const unsigned char * leadin, size_t fetched,
+      segment * previous_segment, tdmsfile * file ) : segment( segment_start, file ) {
+    _read_fetched( leadin, fetched, previous_segment );
+  }
 
-    const char* header = "TDSm";
-    if ( !ok || memcmp( justread, header, 4 ) != 0 ) {
-      throw no_segment_error( );
+  void segment::_read_fetched( const unsigned char * leadin, size_t fetched, segment * previous_segment ) {
+    _parse_leadin( leadin );
+    if ( _next_segment_offset > _parent_file->file_contents_size - _startpos_in_file ) {
+      throw incomplete_segment_error( );
     }
 
-    // First four bytes are toc mask
-    ok = fread( justread, sizeof ( char ), 4, file->f );
-    int32_t toc_mask = read_le<int32_t>( (const unsigned char *) &justread[0] );
-
-    log::debug( ) << "Properties:";
-    for ( auto prop : segment::_toc_properties ) {
-      _toc[prop.first] = ( toc_mask & prop.second ) != 0;
-
-      if ( _toc[prop.first] ) {
-        log::debug( ) << "\t" << prop.first;
+    if ( !_parent_file->_defer_metadata( ) ) {
+      if ( (size_t) _data_offset <= fetched ) {
+        _parse_metadata( leadin + 28, previous_segment );
+      }
+      else {
+        _load_metadata( previous_segment );
       }
     }
-    log::debug( ) << std::endl;
+  }
 
-    // Four bytes for version number
-    ok = fread( justread, sizeof ( char ), 4, file->f );
-    if ( !ok ) {
-      throw read_error( );
+  segment::segment( uulong segment_start, const unsigned char * leadin,
+      segment * previous_segment, tdmsfile * file )
+      : _startpos_in_file( segment_start ), _number( 0 ), _run_length( 1 ),
+      _ordered_chunks( no_chunks( ) ), _parent_file( file ) {
+    // the metadata follows the lead-in directly (as it does in .tdms_index files)
+    _parse_leadin( leadin );
+    if ( file->_defer_metadata( ) ) {
+      // it'll be decoded later
+      return;
     }
+    _parse_metadata( leadin + 28, previous_segment );
+  }
+
+  segment::segment( uulong segment_start, tdmsfile * file )
+      : _toc( 0 ), _next_segment_offset( 0 ), _num_chunks( 0 ), _startpos_in_file( segment_start ),
+      _data_offset( 0 ), _number( 0 ), _run_length( 1 ), _ordered_chunks( no_chunks( ) ),
+      _parent_file( file ) { }
 
-    int32_t version = read_le<int32_t>( (const unsigned char *) &justread[0] );
+  void segment::_parse_leadin( const unsigned char * leadin ) {
+    // First four bytes after the tag are toc mask
+    _toc = read_le<uint32_t>( leadin + 4 );
+    log::debug( ) << "ToC: " << std::hex << _toc << std::dec << std::endl;
+
+    // everything after the ToC is in the segment's byte order
+    endianness e = _leadin_endianness( leadin );
+
+    // Four bytes for version number
+    int32_t version = read_as<int32_t>( leadin + 8, e );
     log::debug( ) << "Version: " << version << std::endl;
     switch ( version ) {
       case 4712:
@@ -71,64 +97,117 @@ namespace TDMS{
 
     // 64 bits pointer to next segment
     // and same for raw data offset
-    ok = fread( justread, sizeof ( char ), 8, file->f );
-    if ( !ok ) {
-      throw read_error( );
-    }
-    uint64_t next_segment_offset = read_le<uint64_t>( (const unsigned char *) &justread[0] );
-    ok = fread( justread, sizeof ( char ), 8, file->f );
-    if ( !ok ) {
-      throw read_error( );
-    }
-    size_t raw_data_offset = read_le<size_t>( (const unsigned char *) &justread[0] );
+    uint64_t next_segment_offset = read_as<uint64_t>( leadin + 12, e );
+    size_t raw_data_offset = read_as<size_t>( leadin + 20, e );
 
-    // we'll add 4+4+4+8+8 = 28 bytes to our offsets
-    // because we've read 28 bytes from the start of the segment
+    // we'll add 28 bytes to our offsets because they are
+    // measured from the end of the lead-in
     this->_data_offset = raw_data_offset + 28; // bytes from start of the segment to data
     log::debug( ) << "raw data starts " << _data_offset << " bytes after the start of segment" << std::endl;
 
 
     if ( next_segment_offset == 0xFFFFFFFFFFFFFFFF ) { // That's 8 times FF, or 16 F's, aka the maximum unsigned int64_t.
-      throw std::runtime_error( "Labview probably crashed, file is corrupt. Not attempting to read." );
+      // Labview is still writing this segment (or crashed while doing so)
+      throw incomplete_segment_error( );
     }
     this->_next_segment_offset = next_segment_offset + 28;
+  }
 
-    // prepare enough space to load the metadata into memory
-    auto segment_metadata = std::vector<unsigned char>( raw_data_offset );
-    // read the metadata into memory (the file stream is currently pointing to
-    // the start of the metadata)
-    ok = fread( segment_metadata.data( ), 1, raw_data_offset, file->f );
-    if ( !ok ) {
-      throw read_error( );
+  segment::~segment( ) { }
+
+  bool segment::_repeated_by( const unsigned char * leadin ) const {
+    // a segment without metadata of its own has this one's layout, so
+    // if its ToC and sizes match too, there's nothing to tell them apart
+    if ( _has( kTocMetaData ) || read_le<uint32_t>( leadin + 4 ) != _toc ) {
+      return false;
     }
+    return ( read_as<uint64_t>( leadin + 12, _endianness( ) ) + 28 == _next_segment_offset
+        && read_as<uint64_t>( leadin + 20, _endianness( ) ) + 28 == (uulong) _data_offset );
+  }
+
+  void segment::_extend_run( uulong count, bool resolved ) {
+    uulong first = _run_length;
+    _run_length += count;
+    if ( resolved ) {
+      _count_values( count );
+      _index_chunks( first, count );
+    }
+  }
 
-    if ( ok != raw_data_offset ) {
-      log::debug( ) << "want to read " << raw_data_offset << ", but only got: " << ok << std::endl;
+  segment segment::_member( uulong member ) const {
+    segment seg( *this );
+    seg._startpos_in_file += member * _next_segment_offset;
+    seg._number += member;
+    seg._run_length = 1;
+    return seg;
+  }
+
+  endianness segment::_leadin_endianness( const unsigned char * leadin ) {
+    // the ToC itself is always little-endian
+    return ( ( read_le<uint32_t>( leadin + 4 ) & kTocBigEndian ) != 0
+        ? endianness::BIG
+        : endianness::LITTLE );
+  }
 
-      auto newdata = std::vector<unsigned char>( raw_data_offset - ok );
-      auto ok2 = fread( newdata.data( ), 1, raw_data_offset - ok, file->f );
+  endianness segment::_endianness( ) const {
+    return ( _has( kTocBigEndian ) ? endianness::BIG : endianness::LITTLE );
+  }
 
-      if ( !ok2 || ok2 < raw_data_offset - ok ) {
-        log::debug( ) << "Double BAM! want to read " << raw_data_offset - ok << ", but only got: " << ok2 << std::endl;
+  const unsigned char * segment::_fetch_metadata( std::vector<unsigned char>& buffer ) {
+    // load the metadata (for memory-mapped files, this is just a pointer
+    // into the mapping)
+    size_t raw_data_offset = _data_offset - 28;
+    const unsigned char * segment_metadata = nullptr;
+    if ( raw_data_offset > 0 ) {
+      segment_metadata = _parent_file->_fetch( _startpos_in_file + 28, raw_data_offset, buffer );
+      if ( nullptr == segment_metadata ) {
+        throw read_error( );
       }
     }
+    return segment_metadata;
+  }
 
-    _parse_metadata( segment_metadata.data( ), previous_segment );
+  void segment::_load_metadata( segment * previous_segment ) {
+    _parse_metadata( _fetch_metadata( _parent_file->metabuff ), previous_segment );
   }
 
-  segment::~segment( ) { }
+  void segment::_parse_metadata( const unsigned char* data, segment * previous_segment ) {
+    _decode_metadata( data );
+    _resolve_metadata( previous_segment );
+  }
+
+  void segment::_decode_metadata( const unsigned char* data ) {
+    // This only reads the object list, and doesn't touch any channels
+    // or other segments, so many segments can be decoded at once
+    _decoded_objects.clear( );
+    if ( !_has( kTocMetaData ) ) {
+      return;
+    }
+    if ( _data_offset <= 28 ) {
+      // there's no metadata to read
+      throw read_error( );
+    }
 
-  void segment::_parse_metadata( const unsigned char* data,segment * previous_segment ) {
-    if ( !this->_toc["kTocMetaData"] ) {
+    // Read number of metadata objects
+    int32_t num_chunks = read_as<int32_t>( data, _endianness( ) );
+    data += 4;
+
+    _decoded_objects.resize( num_chunks );
+    for ( auto& obj : _decoded_objects ) {
+      data = datachunk::_decode_metadata( data, obj, _endianness( ) );
+    }
+  }
+
+  void segment::_resolve_metadata( segment * previous_segment ) {
+    if ( !_has( kTocMetaData ) ) {
       if ( !previous_segment )
         throw std::runtime_error( "kTocMetaData is set for segment, but there is no previous segment." );
-      for ( const auto& chunki : previous_segment->_ordered_chunks ) {
-        this->_ordered_chunks.push_back( chunki );
-      }
+      _ordered_chunks = previous_segment->_ordered_chunks;
       _calculate_chunks( );
       return;
     }
-    if ( !this->_toc["kTocNewObjList"] ) {
+    auto chunks = std::make_shared<chunk_layout>( );
+    if ( !_has( kTocNewObjList ) ) {
       // In this case, there can be a list of new objects that
       // are appended, or previous objects can also be repeated
       // if their properties change
@@ -136,29 +215,21 @@ namespace TDMS{
       if ( !previous_segment ) {
         throw std::runtime_error( "kTocNewObjList is set for segment, but there is no previous segment." );
       }
-      for ( const auto& chunky : previous_segment->_ordered_chunks ) {
-        this->_ordered_chunks.push_back( chunky );
-      }
+      *chunks = *previous_segment->_ordered_chunks;
     }
 
-    // Read number of metadata objects
-    int32_t num_chunks = read_le<int32_t>( data );
-    data += 4;
+    for ( const auto& obj : _decoded_objects ) {
+      log::debug( ) << obj.path << std::endl;
 
-    for ( int i = 0; i < num_chunks; ++i ) {
-      std::string object_path = read_string( data );
-      data += 4 + object_path.size( );
-      log::debug( ) << object_path << std::endl;
-
-      auto channel = _parent_file->find_or_make_channel( object_path );
+      auto channel = _parent_file->find_or_make_channel( obj.path );
       bool updating_existing = false;
 
       datachunk * segment_chunk = nullptr;
 
-      if ( !_toc["kTocNewObjList"] ) {
+      if ( !_has( kTocNewObjList ) ) {
         // Search for the same object from the previous
         // segment object list
-        for ( auto& segchunk : _ordered_chunks ) {
+        for ( auto& segchunk : *chunks ) {
           if ( segchunk._tdms_channel == channel ) {
             segment_chunk = &segchunk;
             updating_existing = true;
@@ -177,13 +248,28 @@ namespace TDMS{
         else {
           newchunk = datachunk{ channel };
         }
-        this->_ordered_chunks.push_back( newchunk );
+        chunks->push_back( newchunk );
 
-        segment_chunk = &this->_ordered_chunks[this->_ordered_chunks.size( ) - 1];
+        segment_chunk = &chunks->back( );
       }
-      data = segment_chunk->_parse_metadata( data );
+      segment_chunk->_apply_metadata( obj );
       channel->_previous_segment_chunk = *segment_chunk;
     }
+    std::vector<object_metadata>( ).swap( _decoded_objects );
+
+    // loggers often repeat the metadata unchanged, so keep sharing the
+    // previous segment's layout when it is the same
+    const chunk_layout * previous = ( previous_segment ? previous_segment->_ordered_chunks.get( ) : nullptr );
+    if ( nullptr != previous && previous->size( ) == chunks->size( )
+        && std::equal( chunks->begin( ), chunks->end( ), previous->begin( ),
+        []( const datachunk& a, const datachunk& b ) {
+          return a._same_layout( b );
+        } ) ) {
+      _ordered_chunks = previous_segment->_ordered_chunks;
+    }
+    else {
+      _ordered_chunks = std::move( chunks );
+    }
     _calculate_chunks( );
   }
 
@@ -195,12 +281,7 @@ namespace TDMS{
     // segment, based on the number of chunks.
 
     // Count the datasize
-    long long data_size = 0;
-    for ( const auto& chunky : _ordered_chunks ) {
-      if ( chunky._has_data ) {
-        data_size += chunky._data_size;
-      }
-    }
+    long long data_size = _chunk_size( );
     long long total_data_size = this->_next_segment_offset - this->_data_offset;
 
     if ( data_size < 0 || total_data_size < 0 ) {
@@ -220,54 +301,634 @@ namespace TDMS{
       this->_num_chunks = total_data_size / data_size;
     }
 
+    _count_values( _run_length );
+    _index_chunks( );
+  }
+
+  void segment::_count_values( uulong segments ) {
     // Update data count for the overall tdms object
     // using the data count for this segment.
-    for ( auto& chunki : this->_ordered_chunks ) {
+    for ( const auto& chunki : *_ordered_chunks ) {
       if ( chunki._has_data ) {
         chunki._tdms_channel->_number_values
-            += ( chunki._number_values * this->_num_chunks );
+            += ( chunki._number_values * this->_num_chunks * segments );
       }
     }
   }
 
-  void segment::_parse_raw_data( listener * listener ) {
-    if ( !this->_toc["kTocRawData"] ) {
+  void segment::_index_chunks( ) {
+    _index_chunks( 0, _run_length );
+  }
+
+  void segment::_index_chunks( uulong first_member, uulong members ) {
+    // Record where each channel's values are in this segment, so
+    // ranges of values can be found without reading every segment
+    if ( 0 == _num_chunks || 0 == members ) {
       return;
     }
 
-    size_t total_data_size = _next_segment_offset - _data_offset;
-    if ( 0 == total_data_size ) {
+    uulong chunk_size = _chunk_size( );
+
+    // DAQmx values are in the rows of the raw buffers, one after another
+    size_t rows = 0;
+    const daqmx_metadata * daqmx = ( _is_daqmx( ) ? _daqmx_layout( rows ) : nullptr );
+
+    // interleaved values are a row apart, and the others are next to each other
+    bool interleaved = _has( kTocInterleavedData );
+    size_t row_width = 0;
+    if ( interleaved ) {
+      _interleaved_rows( row_width );
+    }
+
+    uulong offset = 0;
+    for ( const auto& chunky : *_ordered_chunks ) {
+      if ( !chunky._has_data ) {
+        continue;
+      }
+      uint64_t value_offset = offset;
+      uint64_t stride = ( interleaved ? row_width : chunky._data_type.length( ) );
+      if ( nullptr != daqmx ) {
+        const daqmx_scaler& scaler = chunky._daqmx_scaler( );
+        value_offset = scaler.byte_offset;
+        for ( size_t b = 0; b < scaler.buffer; ++b ) {
+          value_offset += rows * daqmx->widths[b];
+        }
+        stride = daqmx->widths[scaler.buffer];
+      }
+      auto& extents = chunky._tdms_channel->_extents;
+      if ( chunky._number_values > 0 ) {
+        if ( !extents.empty( ) && extents.back( ).seg == this ) {
+          // more of the run, which is laid out the same
+          extents.back( ).segments += members;
+        }
+        else {
+          uint64_t first_value = ( extents.empty( )
+              ? 0
+              : extents.back( ).first_value
+                + extents.back( ).values_per_chunk * extents.back( ).num_chunks * extents.back( ).segments );
+          extents.push_back( data_extent{ this, &chunky, first_value, chunky._number_values, _num_chunks,
+            value_offset, chunk_size, stride, first_member, members } );
+        }
+      }
+      offset += ( interleaved ? chunky._data_type.length( ) : chunky._data_size );
+    }
+  }
+
+  uulong segment::_chunk_size( ) const {
+    uulong chunk_size = 0;
+    if ( _is_daqmx( ) ) {
+      // the DAQmx channels share their raw buffers
+      size_t rows;
+      const daqmx_metadata * layout = _daqmx_layout( rows );
+      if ( nullptr != layout ) {
+        for ( auto width : layout->widths ) {
+          chunk_size += rows * width;
+        }
+      }
+      return chunk_size;
+    }
+    for ( const auto& chunky : *_ordered_chunks ) {
+      if ( chunky._has_data ) {
+        chunk_size += chunky._data_size;
+      }
+    }
+    return chunk_size;
+  }
+
+  bool segment::_has_raw_data( ) const {
+    return ( _has( kTocRawData ) && _next_segment_offset > (size_t) _data_offset );
+  }
+
+  void segment::_parse_raw_data( listener * listener, std::vector<unsigned char>& buffer ) {
+    if ( !_has_raw_data( ) ) {
       // no data in this segment, so nothing to do
       return;
     }
-
-    auto e = endianness::LITTLE;
-    if ( this->_toc["kTocBigEndian"] ) {
-      e = endianness::BIG;
-      throw std::runtime_error( "Big endian reading not yet implemented" );
+    if ( _is_daqmx( ) && _streamed( ) ) {
+      _read_daqmx( listener, buffer, _parent_file->_buffer_limit( ), nullptr );
+      return;
+    }
+    if ( _has( kTocInterleavedData ) ) {
+      _read_interleaved( listener, buffer, ( _streamed( ) ? _parent_file->_buffer_limit( ) : 0 ), nullptr );
+      return;
+    }
+    if ( _streamed( ) ) {
+      _stream_raw_data( listener, buffer, _parent_file->_buffer_limit( ) );
+      return;
     }
 
-    // move the file pointer to the start of this segment's data
-    fseek( _parent_file->f, _startpos_in_file, SEEK_SET );
-    fseek( _parent_file->f, _data_offset, SEEK_CUR );
-    auto ok = fread( _parent_file->segbuff.data( ), total_data_size, 1, _parent_file->f );
-    if ( !ok ) {
+    // read this segment's data (or point into the mapping)
+    unsigned char * columns;
+    const unsigned char * d = _parent_file->_fetch( _startpos_in_file + _data_offset,
+        _next_segment_offset - _data_offset, buffer, _columns_size( ), columns );
+    if ( nullptr == d ) {
       throw read_error( );
     }
-    const unsigned char * d = _parent_file->segbuff.data( );
+    _deliver_raw_data( d, listener, columns );
+  }
+
+  size_t segment::_columns_size( ) const {
+    if ( _has_raw_data( ) && _is_daqmx( ) ) {
+      // every DAQmx channel's values, as doubles, and room to line them up
+      size_t rows;
+      if ( nullptr == _daqmx_layout( rows ) ) {
+        return 0;
+      }
+      size_t size = 0;
+      for ( const auto& chunky : *_ordered_chunks ) {
+        if ( chunky._has_data ) {
+          size += rows * sizeof ( double ) + sizeof ( double );
+        }
+      }
+      return _num_chunks * size;
+    }
+    // interleaved data is split up, and big-endian data swapped, into here
+    return ( _has_raw_data( ) && ( _has( kTocInterleavedData ) || _has( kTocBigEndian ) )
+        ? _next_segment_offset - _data_offset
+        : 0 );
+  }
+
+  void segment::_swap_chunks( const unsigned char * src, size_t num_chunks, unsigned char * dst ) {
+    for ( size_t chunk = 0; chunk < num_chunks; ++chunk ) {
+      for ( const auto& chunky : *_ordered_chunks ) {
+        if ( chunky._has_data ) {
+          _swap_values( chunky, src, dst );
+          src += chunky._data_size;
+          dst += chunky._data_size;
+        }
+      }
+    }
+  }
+
+  void segment::_swap_values( const datachunk& chunky, const unsigned char * src, unsigned char * dst ) {
+    if ( chunky._data_type.is_string( ) ) {
+      // only the offset table needs swapping
+      size_t table_size = std::min<uint64_t>( chunky._number_values * 4, chunky._data_size );
+      byteswap( src, 4, table_size / 4, dst );
+      memcpy( dst + table_size, src + table_size, chunky._data_size - table_size );
+      return;
+    }
+    byteswap( src, chunky._data_type.length( ), chunky._number_values, dst );
+  }
+
+  size_t segment::_interleaved_rows( size_t& row_width ) const {
+    // every channel has one value in each row, so they all need
+    // the same number of values
+    size_t rows = 0;
+    bool first = true;
+    row_width = 0;
+    for ( const auto& chunky : *_ordered_chunks ) {
+      if ( !chunky._has_data ) {
+        continue;
+      }
+      if ( chunky._data_type.is_string( ) ) {
+        throw std::runtime_error( "Interleaved string data is not supported" );
+      }
+      if ( !first && chunky._number_values != rows ) {
+        throw std::runtime_error( "Interleaved channels have different numbers of values" );
+      }
+      rows = chunky._number_values;
+      first = false;
+      row_width += chunky._data_type.length( );
+    }
+    return rows;
+  }
 
+  void segment::_read_interleaved( listener * listener, std::vector<unsigned char>& buffer,
+      size_t limit, const std::set<const channel *> * channels ) {
+    // Rows are the same in every chunk, so the segment is one long list of
+    // rows. Read as many as fit in half the limit, leaving the other half
+    // for the columns they're split into. Every row has to be read, even
+    // when only some of the channels are wanted.
+    size_t row_width;
+    size_t total_rows = _interleaved_rows( row_width ) * _num_chunks;
+    if ( 0 == row_width ) {
+      return;
+    }
+    size_t rows_per_read = ( 0 == limit
+        ? total_rows
+        : std::max<size_t>( 1, limit / ( 2 * row_width ) ) );
+
+    uulong datastart = _startpos_in_file + _data_offset;
+    for ( size_t row = 0; row < total_rows; row += rows_per_read ) {
+      size_t n = std::min( rows_per_read, total_rows - row );
+      unsigned char * columns;
+      const unsigned char * d = _parent_file->_fetch( datastart + row * row_width,
+          n * row_width, buffer, n * row_width, columns );
+      if ( nullptr == d ) {
+        throw read_error( );
+      }
+      _deliver_interleaved( d, n, listener, columns, channels );
+    }
+  }
+
+  void segment::_deliver_interleaved( const unsigned char * d, size_t rows, listener * listener,
+      unsigned char * columns, const std::set<const channel *> * channels ) {
+    size_t row_width;
+    _interleaved_rows( row_width );
+
+    std::vector<const datachunk *> cols;
+    std::vector<size_t> offsets;
+    bool same_width = true;
+    size_t offset = 0;
+    for ( const auto& chunky : *_ordered_chunks ) {
+      if ( !chunky._has_data ) {
+        continue;
+      }
+      if ( nullptr == channels || channels->count( chunky._tdms_channel ) > 0 ) {
+        same_width = same_width && ( cols.empty( )
+            || chunky._data_type.length( ) == cols[0]->_data_type.length( ) );
+        cols.push_back( &chunky );
+        offsets.push_back( offset );
+      }
+      offset += chunky._data_type.length( );
+    }
+    if ( cols.empty( ) ) {
+      return;
+    }
+
+    std::vector<unsigned char *> outputs( cols.size( ) );
+    unsigned char * out = columns;
+    for ( size_t c = 0; c < cols.size( ); ++c ) {
+      outputs[c] = out;
+      out += rows * cols[c]->_data_type.length( );
+    }
+
+    if ( same_width && cols.size( ) * cols[0]->_data_type.length( ) == row_width ) {
+      // every channel is wanted, and they're all the same size,
+      // so this is a straight transpose
+      deinterleave( d, rows, cols.size( ), cols[0]->_data_type.length( ), outputs.data( ) );
+    }
+    else {
+      for ( size_t c = 0; c < cols.size( ); ++c ) {
+        gather( d + offsets[c], row_width, cols[c]->_data_type.length( ), rows, outputs[c] );
+      }
+    }
+
+    if ( endianness::BIG == _endianness( ) ) {
+      for ( size_t c = 0; c < cols.size( ); ++c ) {
+        byteswap( outputs[c], cols[c]->_data_type.length( ), rows, outputs[c] );
+      }
+    }
+
+    if ( listener ) {
+      for ( size_t c = 0; c < cols.size( ); ++c ) {
+        listener->data( cols[c]->_tdms_channel->_path, outputs[c], cols[c]->_data_type, rows );
+      }
+    }
+  }
+
+  bool segment::_is_daqmx( ) const {
+    for ( const auto& chunky : *_ordered_chunks ) {
+      if ( chunky._has_data ) {
+        return ( nullptr != chunky._daqmx );
+      }
+    }
+    return false;
+  }
+
+  const daqmx_metadata * segment::_daqmx_layout( size_t& rows ) const {
+    // every channel has a value in each row of the buffers
+    const datachunk * first = nullptr;
+    rows = 0;
+    for ( const auto& chunky : *_ordered_chunks ) {
+      if ( !chunky._has_data ) {
+        continue;
+      }
+      if ( nullptr == chunky._daqmx ) {
+        throw std::runtime_error( "DAQmx data is mixed with other data in a segment" );
+      }
+      if ( nullptr == first ) {
+        first = &chunky;
+        rows = chunky._number_values;
+      }
+      else if ( chunky._number_values != rows || chunky._daqmx->widths != first->_daqmx->widths ) {
+        throw std::runtime_error( "DAQmx channels in a segment have different raw data layouts" );
+      }
+    }
+    return ( nullptr == first ? nullptr : first->_daqmx.get( ) );
+  }
+
+  void segment::_read_daqmx( listener * listener, std::vector<unsigned char>& buffer,
+      size_t limit, const std::set<const channel *> * channels ) {
+    size_t rows;
+    const daqmx_metadata * layout = _daqmx_layout( rows );
+    if ( nullptr == layout ) {
+      return;
+    }
+
+    // how many of the wanted channels each buffer holds
+    std::vector<size_t> wanted( layout->widths.size( ), 0 );
+    for ( const auto& chunky : *_ordered_chunks ) {
+      if ( chunky._has_data && ( nullptr == channels || channels->count( chunky._tdms_channel ) > 0 ) ) {
+        wanted[chunky._daqmx_scaler( ).buffer]++;
+      }
+    }
+
+    // buffers without wanted channels are skipped, and the others read as
+    // many rows at a time as fit in the limit alongside their values
+    uulong pos = _startpos_in_file + _data_offset;
     for ( size_t chunk = 0; chunk < _num_chunks; ++chunk ) {
-      if ( this->_toc["kTocInterleavedData"] ) {
-        throw std::runtime_error( "Reading interleaved data not supported yet" );
+      for ( size_t b = 0; b < layout->widths.size( ); ++b ) {
+        size_t width = layout->widths[b];
+        size_t row_size = width + wanted[b] * sizeof ( double );
+        size_t rows_per_read = ( 0 == limit ? rows : std::max<size_t>( 1, limit / row_size ) );
+        for ( size_t row = 0; wanted[b] > 0 && row < rows; row += rows_per_read ) {
+          size_t n = std::min( rows_per_read, rows - row );
+          unsigned char * columns;
+          const unsigned char * d = _parent_file->_fetch( pos + row * width, n * width, buffer,
+              wanted[b] * ( n + 1 ) * sizeof ( double ), columns );
+          if ( nullptr == d ) {
+            throw read_error( );
+          }
+          _deliver_daqmx( d, b, n, listener, columns, channels );
+        }
+        pos += rows * width;
+      }
+    }
+  }
+
+  void segment::_deliver_daqmx( const unsigned char * d, size_t buffer_index, size_t rows,
+      listener * listener, unsigned char *& columns, const std::set<const channel *> * channels ) {
+    bool swap = ( endianness::BIG == _endianness( ) );
+    for ( const auto& chunky : *_ordered_chunks ) {
+      if ( !chunky._has_data || ( nullptr != channels && 0 == channels->count( chunky._tdms_channel ) ) ) {
+        continue;
+      }
+      const daqmx_scaler& scaler = chunky._daqmx_scaler( );
+      if ( scaler.buffer != buffer_index ) {
+        continue;
+      }
+      size_t row_width = chunky._daqmx->widths[buffer_index];
+
+      // doubles need lining up
+      uintptr_t misalignment = (uintptr_t) columns % sizeof ( double );
+      unsigned char * out = columns + ( 0 == misalignment ? 0 : sizeof ( double ) - misalignment );
+      columns = out + rows * sizeof ( double );
+
+      const unsigned char * values = d + scaler.byte_offset;
+      if ( scaler.bit >= 0 ) {
+        // digital lines are a single bit of a byte
+        gather( values, row_width, 1, rows, out );
+        for ( size_t i = 0; i < rows; ++i ) {
+          out[i] = ( out[i] >> scaler.bit ) & 1;
+        }
+        if ( listener ) {
+          listener->data( chunky._tdms_channel->_path, out, tdsTypeU8, rows );
+        }
+        continue;
+      }
+
+      data_type_t type = data_type_t::from_code( scaler.data_type );
+      size_t value_size = type.length( );
+      if ( chunky._scaling ) {
+        // a block at a time, so the raw values don't need anywhere to live
+        unsigned char raw[_scaling_block * sizeof ( double )];
+        double * scaled = (double *) out;
+        for ( size_t i = 0; i < rows; i += _scaling_block ) {
+          size_t n = std::min( _scaling_block, rows - i );
+          gather( values + i * row_width, row_width, value_size, n, raw );
+          if ( swap ) {
+            byteswap( raw, value_size, n, raw );
+          }
+          chunky._scaling->apply( raw, scaler.data_type, n, scaled + i );
+        }
+        if ( listener ) {
+          listener->data( chunky._tdms_channel->_path, out, tdsTypeDoubleFloat, rows );
+        }
       }
       else {
-        for ( auto& chunky : _ordered_chunks ) {
-          if ( chunky._has_data ) {
-            size_t bytes_processed = chunky._read_values( d, e, listener );
-            d += bytes_processed;
+        gather( values, row_width, value_size, rows, out );
+        if ( swap ) {
+          byteswap( out, value_size, rows, out );
+        }
+        if ( listener ) {
+          listener->data( chunky._tdms_channel->_path, out, type, rows );
+        }
+      }
+    }
+  }
+
+  bool segment::_streamed( ) const {
+    size_t limit = _parent_file->_buffer_limit( );
+    return ( limit > 0 && _has_raw_data( )
+        && _next_segment_offset - _data_offset + _columns_size( ) > limit );
+  }
+
+  void segment::_stream_raw_data( listener * listener, std::vector<unsigned char>& buffer, size_t limit ) {
+    // big-endian data needs room for a swapped copy as well
+    bool swap = ( endianness::BIG == _endianness( ) );
+    size_t copies = ( swap ? 2 : 1 );
+
+    uulong chunk_size = _chunk_size( );
+    uulong datastart = _startpos_in_file + _data_offset;
+
+    std::vector<std::string_view> strings;
+    if ( chunk_size * copies <= limit ) {
+      // read as many whole chunks as fit
+      size_t chunks_per_read = limit / ( chunk_size * copies );
+      for ( size_t chunk = 0; chunk < _num_chunks; chunk += chunks_per_read ) {
+        size_t n = std::min( chunks_per_read, _num_chunks - chunk );
+        unsigned char * swapped;
+        const unsigned char * d = _parent_file->_fetch( datastart + chunk * chunk_size,
+            n * chunk_size, buffer, ( swap ? n * chunk_size : 0 ), swapped );
+        if ( nullptr == d ) {
+          throw read_error( );
+        }
+        if ( swap ) {
+          _swap_chunks( d, n, swapped );
+          d = swapped;
+        }
+        for ( size_t i = 0; i < n; ++i ) {
+          for ( const auto& chunky : *_ordered_chunks ) {
+            if ( chunky._has_data ) {
+              const unsigned char * values = d;
+              chunky._read_values( values, endianness::LITTLE, listener, strings );
+              d += chunky._data_size;
+            }
           }
         }
       }
+      return;
+    }
+
+    // a chunk doesn't fit, so read each channel's values a few at a time
+    uulong pos = datastart;
+    for ( size_t chunk = 0; chunk < _num_chunks; ++chunk ) {
+      for ( const auto& chunky : *_ordered_chunks ) {
+        if ( chunky._has_data ) {
+          _read_values_in_pieces( chunky, pos, listener, buffer, limit, strings );
+          pos += chunky._data_size;
+        }
+      }
+    }
+  }
+
+  void segment::_read_values_in_pieces( const datachunk& chunky, uulong pos, listener * listener,
+      std::vector<unsigned char>& buffer, size_t limit, std::vector<std::string_view>& strings ) {
+    // reads one chunk's values for one channel, no more than limit bytes at a time
+    bool swap = ( endianness::BIG == _endianness( ) );
+    if ( chunky._data_type.is_string( ) ) {
+      // strings can't be split up without reading their offsets first,
+      // so these are read whole, whatever the limit
+      unsigned char * swapped;
+      const unsigned char * d = _parent_file->_fetch( pos, chunky._data_size, buffer,
+          ( swap ? chunky._data_size : 0 ), swapped );
+      if ( nullptr == d ) {
+        throw read_error( );
+      }
+      if ( swap ) {
+        _swap_values( chunky, d, swapped );
+        d = swapped;
+      }
+      chunky._read_values( d, endianness::LITTLE, listener, strings );
+      return;
+    }
+    size_t value_size = chunky._data_type.length( );
+    size_t values_per_read = std::max<size_t>( 1, limit / ( value_size * ( swap ? 2 : 1 ) ) );
+    for ( size_t v = 0; v < chunky._number_values; v += values_per_read ) {
+      size_t n = std::min<size_t>( values_per_read, chunky._number_values - v );
+      unsigned char * swapped;
+      const unsigned char * d = _parent_file->_fetch( pos + v * value_size, n * value_size, buffer,
+          ( swap ? n * value_size : 0 ), swapped );
+      if ( nullptr == d ) {
+        throw read_error( );
+      }
+      if ( swap ) {
+        byteswap( d, value_size, n, swapped );
+        d = swapped;
+      }
+      if ( listener ) {
+        listener->data( chunky._tdms_channel->_path, d, chunky._data_type, n );
+      }
+    }
+  }
+
+  void segment::_parse_channel_data( const std::set<const channel *>& channels,
+      listener * listener, std::vector<unsigned char>& buffer ) {
+    if ( !_has_raw_data( ) ) {
+      return;
+    }
+    if ( _is_daqmx( ) ) {
+      _read_daqmx( listener, buffer, _parent_file->_buffer_limit( ), &channels );
+      return;
+    }
+    if ( _has( kTocInterleavedData ) ) {
+      _read_interleaved( listener, buffer, _parent_file->_buffer_limit( ), &channels );
+      return;
+    }
+
+    // where the wanted channels are within a chunk
+    std::vector<std::pair<uulong, const datachunk *>> wanted;
+    uulong chunk_size = 0;
+    for ( const auto& chunky : *_ordered_chunks ) {
+      if ( chunky._has_data ) {
+        if ( channels.count( chunky._tdms_channel ) > 0 ) {
+          wanted.emplace_back( chunk_size, &chunky );
+        }
+        chunk_size += chunky._data_size;
+      }
+    }
+    if ( wanted.empty( ) ) {
+      return;
+    }
+
+    // walk the wanted ranges in file order, reading each run of ranges
+    // that are close enough together in one go
+    uulong datastart = _startpos_in_file + _data_offset;
+    size_t nranges = wanted.size( ) * _num_chunks;
+    auto range_start = [&]( size_t r ) {
+      return ( r / wanted.size( ) ) * chunk_size + wanted[r % wanted.size( )].first;
+    };
+    auto range_end = [&]( size_t r ) {
+      return range_start( r ) + wanted[r % wanted.size( )].second->_data_size;
+    };
+
+    // big-endian data needs room for a swapped copy as well
+    bool swap = ( endianness::BIG == _endianness( ) );
+    size_t copies = ( swap ? 2 : 1 );
+    size_t limit = _parent_file->_buffer_limit( );
+    std::vector<std::string_view> strings;
+    size_t first = 0;
+    while ( first < nranges ) {
+      uulong start = range_start( first );
+      if ( limit > 0 && ( range_end( first ) - start ) * copies > limit ) {
+        // too big for the buffer by itself
+        _read_values_in_pieces( *wanted[first % wanted.size( )].second, datastart + start,
+            listener, buffer, limit, strings );
+        ++first;
+        continue;
+      }
+
+      size_t last = first + 1;
+      while ( last < nranges && range_start( last ) - range_end( last - 1 ) <= _coalesce_gap
+          && ( 0 == limit || ( range_end( last ) - start ) * copies <= limit ) ) {
+        ++last;
+      }
+
+      size_t span = range_end( last - 1 ) - start;
+      unsigned char * swapped;
+      const unsigned char * d = _parent_file->_fetch( datastart + start, span, buffer,
+          ( swap ? span : 0 ), swapped );
+      if ( nullptr == d ) {
+        throw read_error( );
+      }
+      for ( size_t r = first; r < last; ++r ) {
+        const datachunk * chunky = wanted[r % wanted.size( )].second;
+        const unsigned char * values = d + ( range_start( r ) - start );
+        if ( swap ) {
+          unsigned char * dst = swapped + ( range_start( r ) - start );
+          _swap_values( *chunky, values, dst );
+          values = dst;
+        }
+        chunky->_read_values( values, endianness::LITTLE, listener, strings );
+      }
+      first = last;
+    }
+  }
+
+  void segment::_deliver_raw_data( const unsigned char * d, listener * listener, unsigned char * columns ) {
+    if ( !_has_raw_data( ) ) {
+      return;
+    }
+
+    if ( _is_daqmx( ) ) {
+      // a chunk is each raw buffer in turn, a row at a time
+      size_t rows;
+      const daqmx_metadata * layout = _daqmx_layout( rows );
+      if ( nullptr == layout ) {
+        return;
+      }
+      for ( size_t chunk = 0; chunk < _num_chunks; ++chunk ) {
+        for ( size_t b = 0; b < layout->widths.size( ); ++b ) {
+          _deliver_daqmx( d, b, rows, listener, columns, nullptr );
+          d += rows * layout->widths[b];
+        }
+      }
+      return;
+    }
+
+    if ( _has( kTocInterleavedData ) ) {
+      size_t row_width;
+      _deliver_interleaved( d, _interleaved_rows( row_width ) * _num_chunks, listener, columns, nullptr );
+      return;
+    }
+
+    if ( endianness::BIG == _endianness( ) ) {
+      // the listener gets the values in this machine's byte order
+      _swap_chunks( d, _num_chunks, columns );
+      d = columns;
+    }
+
+    // one table for decoding this segment's strings into
+    std::vector<std::string_view> strings;
+    for ( size_t chunk = 0; chunk < _num_chunks; ++chunk ) {
+      for ( const auto& chunky : *_ordered_chunks ) {
+        if ( chunky._has_data ) {
+          size_t bytes_processed = chunky._read_values( d, endianness::LITTLE, listener, strings );
+          d += bytes_processed;
+        }
+      }
     }
   }
 }
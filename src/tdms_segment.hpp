@@ -2,11 +2,13 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <set>
 #include <memory>
 
 #include "data_type.h"
 #include "tdms_exports.h"
 #include "datachunk.h"
+#include "tdms_channel.h"
 
 namespace TDMS {
 
@@ -18,29 +20,117 @@ namespace TDMS {
   class segment {
     friend class tdmsfile;
     friend class datachunk;
+    friend class prefetching_loader;
 
   public:
     TDMS_EXPORT segment( uulong segment_start, segment * previous_segment, tdmsfile * file );
+    TDMS_EXPORT segment( uulong segment_start, const unsigned char * leadin,
+        segment * previous_segment, tdmsfile * file );
     TDMS_EXPORT virtual ~segment( );
   private:
+    // a segment whose state is filled in by the caller (for cached metadata)
+    segment( uulong segment_start, tdmsfile * file );
+    // a segment whose lead-in, and the fetched - 28 bytes after it, have
+    // been read already (see tdmsfile::_fetch_leadin); the rest of the
+    // metadata is read if it's needed
+    segment( uulong segment_start, const unsigned char * leadin, size_t fetched,
+        segment * previous_segment, tdmsfile * file );
 
+    void _read_fetched( const unsigned char * leadin, size_t fetched, segment * previous_segment );
+
+    void _parse_leadin( const unsigned char * leadin );
+    // whether the segment with this lead-in is just another one of these
+    bool _repeated_by( const unsigned char * leadin ) const;
+    // makes this stand for count more segments, straight after the ones
+    // it stands for already; resolved says whether the values of those
+    // have been counted yet, so the new ones have to be as well
+    void _extend_run( uulong count, bool resolved );
+    // the member'th of the segments this stands for, on its own
+    segment _member( uulong member ) const;
+    static endianness _leadin_endianness( const unsigned char * leadin );
+    endianness _endianness( ) const;
+    const unsigned char * _fetch_metadata( std::vector<unsigned char>& buffer );
+    void _load_metadata( segment * previous_segment );
     void _parse_metadata( const unsigned char* data, segment * previous_segment );
-    void _parse_raw_data( listener * );
+    void _decode_metadata( const unsigned char* data );
+    void _resolve_metadata( segment * previous_segment );
+    bool _has_raw_data( ) const;
+    void _parse_raw_data( listener *, std::vector<unsigned char>& buffer );
+    bool _streamed( ) const;
+    void _stream_raw_data( listener *, std::vector<unsigned char>& buffer, size_t limit );
+    void _read_values_in_pieces( const datachunk& chunky, uulong pos, listener *,
+        std::vector<unsigned char>& buffer, size_t limit, std::vector<std::string_view>& strings );
+    // columns needs room for _columns_size( ) bytes
+    void _deliver_raw_data( const unsigned char * data, listener *, unsigned char * columns );
+    size_t _columns_size( ) const;
+    void _swap_chunks( const unsigned char * src, size_t num_chunks, unsigned char * dst );
+    static void _swap_values( const datachunk& chunky, const unsigned char * src, unsigned char * dst );
+    size_t _interleaved_rows( size_t& row_width ) const;
+    void _read_interleaved( listener *, std::vector<unsigned char>& buffer, size_t limit,
+        const std::set<const channel *> * channels );
+    void _deliver_interleaved( const unsigned char * data, size_t rows, listener *,
+        unsigned char * columns, const std::set<const channel *> * channels );
+    bool _is_daqmx( ) const;
+    // the layout every DAQmx channel in the segment shares, or nullptr
+    // if none of them has data
+    const daqmx_metadata * _daqmx_layout( size_t& rows ) const;
+    void _read_daqmx( listener *, std::vector<unsigned char>& buffer, size_t limit,
+        const std::set<const channel *> * channels );
+    // delivers the channels in raw buffer number buffer_index, moving
+    // columns past the values written there
+    void _deliver_daqmx( const unsigned char * data, size_t buffer_index, size_t rows, listener *,
+        unsigned char *& columns, const std::set<const channel *> * channels );
+    uulong _chunk_size( ) const;
+    void _parse_channel_data( const std::set<const channel *>& channels, listener *,
+        std::vector<unsigned char>& buffer );
     void _calculate_chunks( );
+    void _count_values( uulong segments );
+    void _index_chunks( );
+    void _index_chunks( uulong first_member, uulong members );
+
+    // the ToC bits of the lead-in
+    enum : uint32_t {
+      kTocMetaData = 1u << 1,
+      kTocNewObjList = 1u << 2,
+      kTocRawData = 1u << 3,
+      kTocInterleavedData = 1u << 5,
+      kTocBigEndian = 1u << 6,
+      kTocDAQmxRawData = 1u << 7
+    };
+
+    bool _has( uint32_t toc_bit ) const {
+      return ( _toc & toc_bit ) != 0;
+    }
+
+    // the objects in a chunk, in the order their values are in
+    typedef std::vector<datachunk> chunk_layout;
 
-    // Probably a map using enums performs faster.
-    // Will only give a little performance though.
-    // Perhaps use a struct for the _toc, so we don't need
-    // the std::map and don't have to do lookups.
-    std::map<std::string, bool> _toc;
+    uint32_t _toc;
     size_t _next_segment_offset;
     size_t _num_chunks;
     uulong _startpos_in_file;
     long _data_offset; // bytes of data between _startpos and the raw data
-    std::vector<datachunk> _ordered_chunks;
+    // the number of the segment in the file, and how many segments this
+    // stands for. A run of segments without metadata (no kTocMetaData),
+    // all laid out alike, is kept as the first of them, the others
+    // following every _next_segment_offset bytes. A segment with
+    // metadata always stands for just itself, so a run can't start
+    // there; it starts at the segment after it.
+    uulong _number;
+    uulong _run_length;
+    // shared with the segments around this one for as long as the
+    // metadata leaves it unchanged
+    std::shared_ptr<const chunk_layout> _ordered_chunks;
+    // the object list, between decoding and resolving the metadata
+    std::vector<object_metadata> _decoded_objects;
 
     tdmsfile * _parent_file;
 
-    static const std::map<const std::string, int32_t> _toc_properties;
+    // how much past the lead-in to read when looking for a segment
+    static const size_t _metadata_readahead = 4096;
+    // ranges of wanted data closer together than this are read together
+    static const size_t _coalesce_gap = 4096;
+    // DAQmx values converted and scaled at a time
+    static constexpr size_t _scaling_block = 1024;
   };
 }
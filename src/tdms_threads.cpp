@@ -0,0 +1,65 @@
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "tdms_threads.hpp"
+
+namespace TDMS{
+
+  unsigned thread_count( unsigned requested ) {
+    if ( 0 != requested ) {
+      return requested;
+    }
+    unsigned cores = std::thread::hardware_concurrency( );
+    return ( 0 == cores ? 1 : cores );
+  }
+
+  void parallel_for( size_t count, unsigned threads,
+      const std::function<void( size_t, unsigned )>& fn ) {
+    threads = thread_count( threads );
+    if ( threads > count ) {
+      threads = (unsigned) count;
+    }
+    if ( threads <= 1 ) {
+      for ( size_t i = 0; i < count; ++i ) {
+        fn( i, 0 );
+      }
+      return;
+    }
+
+    std::atomic<size_t> next( 0 );
+    std::atomic<bool> failed( false );
+    std::exception_ptr error;
+    std::mutex errorlock;
+
+    auto work = [&]( unsigned worker ) {
+      for ( size_t i = next++; i < count && !failed; i = next++ ) {
+        try {
+          fn( i, worker );
+        }
+        catch ( ... ) {
+          std::lock_guard<std::mutex> lock( errorlock );
+          if ( !error ) {
+            error = std::current_exception( );
+          }
+          failed = true;
+        }
+      }
+    };
+
+    std::vector<std::thread> pool;
+    for ( unsigned t = 1; t < threads; ++t ) {
+      pool.emplace_back( work, t );
+    }
+    work( 0 );
+    for ( auto& t : pool ) {
+      t.join( );
+    }
+
+    if ( error ) {
+      std::rethrow_exception( error );
+    }
+  }
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+
+#include "tdms_exports.h"
+
+namespace TDMS {
+
+  /**
+   * Works out how many threads to use when asked for the given number;
+   * 0 means one per core.
+   */
+  TDMS_EXPORT unsigned thread_count( unsigned requested );
+
+  /**
+   * Calls fn( i, worker ) for every i in [0, count), spread over up to
+   * the given number of threads. worker is in [0, threads), and no two
+   * calls with the same worker run at the same time, so it can be used
+   * to pick per-thread buffers. If any call throws, the remaining work is
+   * abandoned and the first exception is rethrown here.
+   */
+  TDMS_EXPORT void parallel_for( size_t count, unsigned threads,
+      const std::function<void( size_t, unsigned )>& fn );
+}
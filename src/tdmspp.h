@@ -19,8 +19,11 @@
 #include "tdms_channel.h"
 #include "tdms_segment.hpp"
 #include "tdms_file.hpp"
+#include "tdms_prefetch.hpp"
 #include "tdms_listener.h"
 #include "data_type.h"
+#include "data_conversion.hpp"
+#include "object_path.hpp"
 #include "datachunk.h"
 #include "log.hpp"
 
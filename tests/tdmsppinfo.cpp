@@ -9,7 +9,7 @@
 // Define options
 
 enum optionIndex{
-  UNKNOWN, HELP, PROPERTIES, DEBUG, DATA, SIGNAL
+  UNKNOWN, HELP, PROPERTIES, DEBUG, DATA, SIGNAL, MMAP, CACHE
 };
 
 const option::Descriptor usage[] = {
@@ -19,6 +19,8 @@ const option::Descriptor usage[] = {
   {DEBUG, 0, "d", "debug", option::Arg::None, "  --debug, \tPrint debugging information to stderr." },
   {DATA, 0, "D", "data", option::Arg::None, "  --data, \tPrint data (BIG!)." },
   {SIGNAL, 0, "s", "signal", option::Arg::Optional, "  --signal, \tOnly look at this signal." },
+  {MMAP, 0, "m", "mmap", option::Arg::None, "  --mmap, \tMemory-map the file instead of reading it." },
+  {CACHE, 0, "c", "cache", option::Arg::None, "  --cache, \tKeep a snapshot of the parsed metadata next to the file." },
   {0, 0, 0, 0, 0, 0 }
 };
 
@@ -46,15 +48,32 @@ public:
         //
         //    }
 
-        memcpy( vals.data( ), datablock, datatype.length( ) * num_vals );
-
         std::cout << channelname << std::endl;
+        if ( !TDMS::is_convertible( datatype.code( ), TDMS::tdsTypeDoubleFloat ) ) {
+          std::cout << "  <" << datatype.name( ) << " values>" << std::endl;
+          return;
+        }
+        TDMS::convert( datablock, datatype.code( ), num_vals, vals.data( ), TDMS::tdsTypeDoubleFloat );
+
         for ( size_t i = 0; i < num_vals; i++ ) {
           std::cout << "  " << std::setprecision( 4 ) << std::fixed << vals[i] << std::endl;
         }
       }
     }
   }
+
+  virtual void string_data( const std::string& channelname, const std::string_view* values, size_t num_vals ) override {
+    if ( signal.empty( ) || std::string::npos != channelname.find( signal ) ) {
+      std::cout << "reading " << num_vals << " for channel: " << channelname << std::endl;
+
+      if ( printdata ) {
+        std::cout << channelname << std::endl;
+        for ( size_t i = 0; i < num_vals; i++ ) {
+          std::cout << "  " << values[i] << std::endl;
+        }
+      }
+    }
+  }
 };
 
 int main( int argc, char** argv ) {
@@ -86,7 +105,10 @@ int main( int argc, char** argv ) {
     if ( _filenames.size( ) > 1 ) {
       std::cout << filename << ":" << std::endl;
     }
-    TDMS::tdmsfile f( filename );
+    TDMS::open_options opts;
+    opts.memory_map = options[MMAP];
+    opts.use_cache = options[CACHE];
+    TDMS::tdmsfile f( filename, opts );
     std::cout << f.segments( ) << " segments parsed" << std::endl;
 
     for ( const auto& o : f ) {
@@ -98,10 +120,10 @@ int main( int argc, char** argv ) {
           if ( valtype.is_string( ) ) {
             std::cout << "  " << p.first << " (string): " << p.second->asString( ) << std::endl;
           }
-          else if ( valtype.name( ) == "tdsTypeDoubleFloat" ) {
+          else if ( valtype == TDMS::tdsTypeDoubleFloat ) {
             std::cout << "  " << p.first << " (double): " << p.second->asDouble( ) << std::endl;
           }
-          else if ( valtype.name( ) == "tdsTypeTimeStamp" ) {
+          else if ( valtype == TDMS::tdsTypeTimeStamp ) {
             time_t timer = p.second->asUTCTimestamp( );
             tm * pt = gmtime( &timer );
             if ( nullptr == pt ) {
@@ -110,7 +132,8 @@ int main( int argc, char** argv ) {
             else {
               char buffer2[80];
               sprintf( buffer2, "%d.%02d.%d %02d:%02d:%02d,%f",
-                  pt->tm_mday, pt->tm_mon + 1, 1900 + pt->tm_year, pt->tm_hour, pt->tm_min, pt->tm_sec, 0.0 );
+                  pt->tm_mday, pt->tm_mon + 1, 1900 + pt->tm_year, pt->tm_hour, pt->tm_min, pt->tm_sec,
+                  p.second->asTimestamp( ).fraction * 0x1p-64 );
               std::cout << "  " << p.first << " (timestamp): " << buffer2 << std::endl;
             }
           }
@@ -133,8 +156,7 @@ int main( int argc, char** argv ) {
       listener.signal = options[SIGNAL].arg;
     }
 
-    for ( size_t i = 0; i < f.segments( ); i++ ) {
-      f.loadSegment( i, &listener );
-    }
+    TDMS::prefetching_loader loader( f );
+    loader.load_all( &listener );
   }
 }
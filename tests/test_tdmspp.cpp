@@ -0,0 +1,1638 @@
+/*
+ * Writes small TDMS files, then reads them back through every loader
+ * and with every open_options setting that changes how they are read,
+ * checking the values against what was written. Checks of the decoding
+ * kernels on their own are run the same way, by name.
+ *
+ * Usage: test_tdmspp <directory for the files> <fixture or check>
+ */
+
+#include "tdmspp.h"
+#include "data_kernels.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+using namespace TDMS;
+
+namespace {
+
+  // the ToC bits of a lead-in
+  const uint32_t toc_metadata = 1u << 1;
+  const uint32_t toc_new_obj_list = 1u << 2;
+  const uint32_t toc_raw_data = 1u << 3;
+  const uint32_t toc_interleaved = 1u << 5;
+  const uint32_t toc_big_endian = 1u << 6;
+  const uint32_t toc_daqmx = 1u << 7;
+
+  int failures = 0;
+
+  void check( bool ok, const std::string& what ) {
+    if ( !ok ) {
+      ++failures;
+      std::cerr << "FAILED: " << what << std::endl;
+    }
+  }
+
+  /**
+   * Bytes as a segment stores them, in its byte order
+   */
+  struct bytes {
+    bool big = false;
+    std::string data;
+
+    template<typename T>
+    bytes& put( T value ) {
+      char b[sizeof ( T )];
+      memcpy( b, &value, sizeof ( T ) );
+      if ( big ) {
+        std::reverse( b, b + sizeof ( T ) );
+      }
+      data.append( b, sizeof ( T ) );
+      return *this;
+    }
+
+    bytes& put_string( const std::string& s ) {
+      put<uint32_t>( s.size( ) );
+      data += s;
+      return *this;
+    }
+  };
+
+  struct property {
+    std::string name;
+    tds_type_code type;
+    double number;
+    std::string text;
+    // for timestamps
+    uint64_t fraction = 0;
+    int64_t seconds = 0;
+  };
+
+  void put_properties( bytes& meta, const std::vector<property>& properties ) {
+    meta.put<uint32_t>( properties.size( ) );
+    for ( const auto& p : properties ) {
+      meta.put_string( p.name ).put<uint32_t>( p.type );
+      switch ( p.type ) {
+        case tdsTypeString:
+          meta.put_string( p.text );
+          break;
+        case tdsTypeI32:
+          meta.put<int32_t>( p.number );
+          break;
+        case tdsTypeU32:
+          meta.put<uint32_t>( p.number );
+          break;
+        case tdsTypeTimeStamp:
+          meta.put( p.fraction ).put( p.seconds );
+          break;
+        case tdsTypeSingleFloat:
+        case tdsTypeSingleFloatWithUnit:
+          meta.put<float>( p.number );
+          break;
+        default:
+          meta.put<double>( p.number );
+      }
+    }
+  }
+
+  void no_data_object( bytes& meta, const std::string& path,
+      const std::vector<property>& properties = { } ) {
+    meta.put_string( path ).put<uint32_t>( 0xFFFFFFFF );
+    put_properties( meta, properties );
+  }
+
+  void numeric_object( bytes& meta, const std::string& path, tds_type_code type, uint64_t count,
+      const std::vector<property>& properties = { } ) {
+    meta.put_string( path ).put<uint32_t>( 20 ).put<uint32_t>( type ).put<uint32_t>( 1 ).put<uint64_t>( count );
+    put_properties( meta, properties );
+  }
+
+  // an object whose data is laid out as in the segment before
+  void same_object( bytes& meta, const std::string& path, const std::vector<property>& properties = { } ) {
+    meta.put_string( path ).put<uint32_t>( 0 );
+    put_properties( meta, properties );
+  }
+
+  void string_object( bytes& meta, const std::string& path, uint64_t count, uint64_t size ) {
+    meta.put_string( path ).put<uint32_t>( 28 ).put<uint32_t>( tdsTypeString ).put<uint32_t>( 1 )
+        .put<uint64_t>( count ).put<uint64_t>( size );
+    put_properties( meta, { } );
+  }
+
+  // where a DAQmx channel's values are in the raw buffers
+  struct daqmx_scaler {
+    uint32_t type;
+    uint32_t buffer;
+    uint32_t offset;
+    uint32_t scale_id;
+  };
+
+  void daqmx_object( bytes& meta, const std::string& path, uint32_t raw_data_index, uint64_t rows,
+      const daqmx_scaler& scaler, const std::vector<uint32_t>& widths,
+      const std::vector<property>& properties ) {
+    meta.put_string( path ).put<uint32_t>( raw_data_index ).put<uint32_t>( tdsTypeDAQmxRawData )
+        .put<uint32_t>( 1 ).put<uint64_t>( rows );
+    meta.put<uint32_t>( 1 ).put( scaler.type ).put( scaler.buffer ).put( scaler.offset )
+        .put<uint8_t>( 0 ).put( scaler.scale_id );
+    meta.put<uint32_t>( widths.size( ) );
+    for ( auto width : widths ) {
+      meta.put( width );
+    }
+    put_properties( meta, properties );
+  }
+
+  /**
+   * An 80-bit extended float as TDMS stores it: the 64-bit mantissa,
+   * with its integer bit, then the sign and the 15-bit exponent, padded
+   * to 16 bytes
+   */
+  std::string extended( bool negative, uint16_t exponent, uint64_t mantissa ) {
+    bytes b;
+    b.put( mantissa ).put<uint16_t>( ( negative ? 0x8000 : 0 ) | exponent );
+    b.data.resize( 16, '\0' );
+    return b.data;
+  }
+
+  /**
+   * Extended floats, and the doubles they round to
+   */
+  const std::vector<std::pair<std::string, double>> extended_values = {
+    { extended( false, 16383, 0x8000000000000000 ), 1.0 },
+    { extended( true, 16384, 0xA000000000000000 ), -2.5 },
+    { extended( false, 16379, 0xCCCCCCCCCCCCCCCD ), 0.1 },
+    { extended( false, 0, 0 ), 0.0 },
+    { extended( true, 0, 0 ), -0.0 },
+    // halfway between doubles, to even (down, then up), and past halfway
+    { extended( false, 16383, 0x8000000000000400 ), 1.0 },
+    { extended( false, 16383, 0x8000000000000C00 ), 1.0 + 0x1p-51 },
+    { extended( false, 16383, 0x8000000000000401 ), 1.0 + 0x1p-52 },
+    // the largest double, and values too big for one
+    { extended( false, 16383 + 1023, 0xFFFFFFFFFFFFF800 ), 0x1.fffffffffffffp1023 },
+    { extended( false, 16383 + 1023, 0xFFFFFFFFFFFFFFFF ), HUGE_VAL },
+    { extended( false, 16383 + 1024, 0x8000000000000000 ), HUGE_VAL },
+    { extended( true, 0x7FFF, 0x8000000000000000 ), -HUGE_VAL },
+    // the smallest normal double, subnormals, and values too small for one
+    { extended( false, 16383 - 1022, 0x8000000000000000 ), 0x1p-1022 },
+    { extended( false, 16383 - 1023, 0x8000000000000000 ), 0x1p-1023 },
+    { extended( false, 16383 - 1074, 0x8000000000000000 ), 0x1p-1074 },
+    { extended( false, 16383 - 1075, 0xC000000000000000 ), 0x1p-1074 },
+    { extended( false, 16383 - 1075, 0x8000000000000000 ), 0.0 },
+    { extended( true, 16383 - 1076, 0xC000000000000000 ), -0.0 },
+    { extended( false, 1, 0x8000000000000000 ), 0.0 }
+  };
+
+  /**
+   * A TDMS timestamp (seconds since 1904, and a fraction of a second in
+   * units of 2^-64 s), and what it converts to
+   */
+  struct timestamp_value {
+    int64_t seconds;
+    uint64_t fraction;
+    int64_t unix_nanoseconds;
+    double unix_seconds;
+  };
+
+  // the TDMS epoch, in seconds before the Unix one
+  const int64_t epoch_1904 = 2082844800;
+
+  const std::vector<timestamp_value> timestamp_values = {
+    { epoch_1904, 0, 0, 0.0 },
+    { 0, 0, -epoch_1904 * 1000000000, -2082844800.0 },
+    { epoch_1904 + 1700000000, 1ull << 63, 1700000000500000000, 1700000000.5 },
+    // before 1904
+    { -1, 1ull << 63, -2082844800500000000, -2082844800.5 },
+    { epoch_1904 - 31536000, 1ull << 62, -31535999750000000, -31535999.75 },
+    // fractions of a nanosecond round to nearest: 1.6 ns, 1.4 ns, 0.23 ns,
+    // and a hair under a second, which carries into the seconds
+    { epoch_1904, 0x6df37f676, 2, 0x1.b7cdfd9d8p-30 },
+    { epoch_1904, 0x60350f7a7, 1, 0x1.80d43de9cp-30 },
+    { epoch_1904 + 1, 1ull << 32, 1000000000, 1.0 + 0x1p-32 },
+    { epoch_1904, 0xFFFFFFFFFFFFFFFF, 1000000000, 1.0 }
+  };
+
+  std::string timestamps_as_stored( ) {
+    bytes b;
+    for ( const auto& t : timestamp_values ) {
+      b.put( t.fraction ).put( t.seconds );
+    }
+    return b.data;
+  }
+
+  /**
+   * A file to write, and what reading it should give
+   */
+  struct fixture {
+    std::string name;
+    std::vector<std::string> segments;
+    // the segments' entries in the index file
+    std::vector<std::string> index;
+    std::map<std::string, std::vector<double>> values;
+    std::map<std::string, std::vector<std::string>> strings;
+    // the values of the channels the loaders deliver scaled (DAQmx ones)
+    // as they are before scaling
+    std::map<std::string, std::vector<double>> unscaled;
+    // further checks of the file, if any
+    std::function<void( tdmsfile&, const std::string& )> check_file;
+    // the objects the file mentions, in the order it first does
+    std::vector<std::string> paths;
+    // whether the segments of each run really are alike, which reading
+    // only some of their lead-ins takes on trust
+    bool runs_alike = true;
+
+    void add_segment( uint32_t toc, const bytes& meta, const bytes& raw ) {
+      if ( !meta.data.empty( ) ) {
+        toc |= toc_metadata;
+      }
+      if ( !raw.data.empty( ) ) {
+        toc |= toc_raw_data;
+      }
+      if ( meta.big ) {
+        toc |= toc_big_endian;
+      }
+      // the ToC is little-endian, whatever the rest of the segment is
+      bytes leadin;
+      leadin.put<uint32_t>( toc );
+      leadin.big = meta.big;
+      leadin.put<uint32_t>( 4713 ).put<uint64_t>( meta.data.size( ) + raw.data.size( ) )
+          .put<uint64_t>( meta.data.size( ) );
+      segments.push_back( "TDSm" + leadin.data + meta.data + raw.data );
+      index.push_back( "TDSh" + leadin.data + meta.data );
+    }
+
+    // writes the first num_segments segments, and their index
+    void write( const std::string& filename, size_t num_segments ) const {
+      std::ofstream data( filename, std::ios::binary | std::ios::trunc );
+      std::ofstream idx( filename + "_index", std::ios::binary | std::ios::trunc );
+      for ( size_t i = 0; i < num_segments; ++i ) {
+        data << segments[i];
+        idx << index[i];
+      }
+    }
+  };
+
+  std::string channel_path( size_t c ) {
+    return "/'g'/'c" + std::to_string( c ) + "'";
+  }
+
+  /**
+   * Three double channels: a segment with the object list, a run of
+   * segments without metadata, a change of layout, a segment with only
+   * a new property, and another run
+   */
+  fixture runs( ) {
+    fixture fx;
+    fx.name = "runs";
+    fx.paths = { "/", "/'g'", channel_path( 0 ), channel_path( 1 ), channel_path( 2 ) };
+    size_t counts[3] = { 4, 4, 4 };
+    for ( size_t seg = 0; seg < 14; ++seg ) {
+      bytes meta;
+      if ( 0 == seg ) {
+        meta.put<uint32_t>( 5 );
+        no_data_object( meta, "/", { { "name", tdsTypeString, 0, "runs" } } );
+        no_data_object( meta, "/'g'" );
+        for ( size_t c = 0; c < 3; ++c ) {
+          numeric_object( meta, channel_path( c ), tdsTypeDoubleFloat, counts[c] );
+        }
+      }
+      else if ( 6 == seg ) {
+        counts[0] = 6;
+        meta.put<uint32_t>( 1 );
+        numeric_object( meta, channel_path( 0 ), tdsTypeDoubleFloat, counts[0] );
+      }
+      else if ( 9 == seg ) {
+        meta.put<uint32_t>( 1 );
+        no_data_object( meta, "/'g'", { { "note", tdsTypeDoubleFloat, 1.5, "" } } );
+      }
+      bytes raw;
+      for ( size_t c = 0; c < 3; ++c ) {
+        for ( size_t i = 0; i < counts[c]; ++i ) {
+          double v = seg * 100.0 + c * 10.0 + i;
+          raw.put( v );
+          fx.values[channel_path( c )].push_back( v );
+        }
+      }
+      fx.add_segment( 0 == seg ? toc_new_obj_list : 0, meta, raw );
+    }
+    return fx;
+  }
+
+  /**
+   * Layout changes of every kind: a channel's count changing and changing
+   * back, metadata that only adds properties, a channel added to the
+   * list, a new list that drops a channel and reorders the rest, and a
+   * dropped channel coming back as it was
+   */
+  fixture layouts( ) {
+    fixture fx;
+    fx.name = "layouts";
+    fx.paths = { "/'g'", channel_path( 0 ), channel_path( 1 ), channel_path( 2 ) };
+    // the channels in each segment, and how many values each has
+    std::vector<std::pair<size_t, size_t>> list = { { 0, 3 }, { 1, 3 } };
+    for ( size_t seg = 0; seg < 12; ++seg ) {
+      bytes meta;
+      uint32_t toc = 0;
+      switch ( seg ) {
+        case 0:
+          toc = toc_new_obj_list;
+          meta.put<uint32_t>( 3 );
+          no_data_object( meta, "/'g'" );
+          numeric_object( meta, channel_path( 0 ), tdsTypeDoubleFloat, 3 );
+          numeric_object( meta, channel_path( 1 ), tdsTypeDoubleFloat, 3 );
+          break;
+        case 2:
+        case 3:
+          list[0].second = ( 2 == seg ? 5 : 3 );
+          meta.put<uint32_t>( 1 );
+          numeric_object( meta, channel_path( 0 ), tdsTypeDoubleFloat, list[0].second );
+          break;
+        case 4:
+          meta.put<uint32_t>( 2 );
+          no_data_object( meta, "/'g'", { { "note", tdsTypeDoubleFloat, 1.5, "" } } );
+          same_object( meta, channel_path( 1 ), { { "unit", tdsTypeString, 0, "V" } } );
+          break;
+        case 6:
+          list.push_back( { 2, 2 } );
+          meta.put<uint32_t>( 1 );
+          numeric_object( meta, channel_path( 2 ), tdsTypeDoubleFloat, 2 );
+          break;
+        case 8:
+          toc = toc_new_obj_list;
+          list = { { 2, 2 }, { 0, 4 } };
+          meta.put<uint32_t>( 2 );
+          same_object( meta, channel_path( 2 ) );
+          numeric_object( meta, channel_path( 0 ), tdsTypeDoubleFloat, 4 );
+          break;
+        case 10:
+          toc = toc_new_obj_list;
+          list = { { 1, 3 } };
+          meta.put<uint32_t>( 1 );
+          same_object( meta, channel_path( 1 ) );
+          break;
+      }
+      bytes raw;
+      for ( const auto& c : list ) {
+        for ( size_t i = 0; i < c.second; ++i ) {
+          double v = seg * 100.0 + c.first * 10.0 + i;
+          raw.put( v );
+          fx.values[channel_path( c.first )].push_back( v );
+        }
+      }
+      fx.add_segment( toc, meta, raw );
+    }
+    fx.check_file = []( tdmsfile& f, const std::string& what ) {
+      auto properties = f[channel_path( 1 )]->get_properties( );
+      check( properties.end( ) != properties.find( "unit" ) && "V" == properties.at( "unit" )->asString( ),
+          what + ": property added without a new layout" );
+      properties = f["/'g'"]->get_properties( );
+      check( properties.end( ) != properties.find( "note" ), what + ": group property" );
+    };
+    return fx;
+  }
+
+  /**
+   * Enough channels for the registry to grow its table several times
+   */
+  fixture many_channels( ) {
+    fixture fx;
+    fx.name = "many_channels";
+    const size_t count = 300;
+    auto path = []( size_t c ) {
+      return "/'many'/'ch" + std::to_string( c ) + "'";
+    };
+    fx.paths.push_back( "/'many'" );
+    for ( size_t c = 0; c < count; ++c ) {
+      fx.paths.push_back( path( c ) );
+    }
+    for ( size_t seg = 0; seg < 3; ++seg ) {
+      bytes meta;
+      if ( 0 == seg ) {
+        meta.put<uint32_t>( count + 1 );
+        no_data_object( meta, "/'many'" );
+        for ( size_t c = 0; c < count; ++c ) {
+          numeric_object( meta, path( c ), tdsTypeI32, 2 );
+        }
+      }
+      bytes raw;
+      for ( size_t c = 0; c < count; ++c ) {
+        for ( int32_t i = 0; i < 2; ++i ) {
+          int32_t v = seg * 10000 + c * 10 + i;
+          raw.put( v );
+          fx.values[path( c )].push_back( v );
+        }
+      }
+      fx.add_segment( 0 == seg ? toc_new_obj_list : 0, meta, raw );
+    }
+    return fx;
+  }
+
+  /**
+   * The runs fixture, with an index that is out of date: a segment in
+   * the middle of the first run has been rewritten with its values
+   * interleaved, which the index doesn't say, so the index mustn't be
+   * used
+   */
+  fixture stale_index( ) {
+    fixture fx = runs( );
+    fx.name = "stale_index";
+    fx.runs_alike = false;
+    const size_t seg = 3;
+    bytes raw;
+    for ( size_t i = 0; i < 4; ++i ) {
+      for ( size_t c = 0; c < 3; ++c ) {
+        raw.put( seg * 100.0 + c * 10.0 + i );
+      }
+    }
+    fixture rewritten;
+    rewritten.add_segment( toc_interleaved, bytes( ), raw );
+    fx.segments[seg] = rewritten.segments[0];
+    return fx;
+  }
+
+  /**
+   * Channels of different widths, interleaved a row at a time
+   */
+  fixture interleaved( ) {
+    fixture fx;
+    fx.name = "interleaved";
+    fx.paths = { "/'g'", channel_path( 0 ), channel_path( 1 ), channel_path( 2 ) };
+    const size_t rows = 5;
+    for ( size_t seg = 0; seg < 4; ++seg ) {
+      bytes meta;
+      if ( 0 == seg ) {
+        meta.put<uint32_t>( 4 );
+        no_data_object( meta, "/'g'" );
+        numeric_object( meta, channel_path( 0 ), tdsTypeI16, rows );
+        numeric_object( meta, channel_path( 1 ), tdsTypeI32, rows );
+        numeric_object( meta, channel_path( 2 ), tdsTypeDoubleFloat, rows );
+      }
+      bytes raw;
+      for ( size_t r = 0; r < rows; ++r ) {
+        int16_t a = -1000 + seg * 10 + r;
+        int32_t b = 100000 * ( seg + 1 ) + r;
+        double c = seg + r / 8.0;
+        raw.put( a ).put( b ).put( c );
+        fx.values[channel_path( 0 )].push_back( a );
+        fx.values[channel_path( 1 )].push_back( b );
+        fx.values[channel_path( 2 )].push_back( c );
+      }
+      fx.add_segment( toc_interleaved | ( 0 == seg ? toc_new_obj_list : 0 ), meta, raw );
+    }
+    return fx;
+  }
+
+  /**
+   * Big-endian segments of several types, one of which changes its
+   * number of values
+   */
+  fixture big_endian( ) {
+    fixture fx;
+    fx.name = "big_endian";
+    fx.paths = { "/'g'", channel_path( 0 ), channel_path( 1 ), channel_path( 2 ), channel_path( 3 ) };
+    size_t count = 3;
+    for ( size_t seg = 0; seg < 5; ++seg ) {
+      bytes meta;
+      meta.big = true;
+      if ( 0 == seg ) {
+        meta.put<uint32_t>( 5 );
+        no_data_object( meta, "/'g'" );
+        numeric_object( meta, channel_path( 0 ), tdsTypeI32, count );
+        numeric_object( meta, channel_path( 1 ), tdsTypeSingleFloat, count );
+        numeric_object( meta, channel_path( 2 ), tdsTypeU16, count );
+        numeric_object( meta, channel_path( 3 ), tdsTypeI64, count );
+      }
+      else if ( 3 == seg ) {
+        count = 7;
+        meta.put<uint32_t>( 4 );
+        numeric_object( meta, channel_path( 0 ), tdsTypeI32, count );
+        numeric_object( meta, channel_path( 1 ), tdsTypeSingleFloat, count );
+        numeric_object( meta, channel_path( 2 ), tdsTypeU16, count );
+        numeric_object( meta, channel_path( 3 ), tdsTypeI64, count );
+      }
+      bytes raw;
+      raw.big = true;
+      for ( size_t i = 0; i < count; ++i ) {
+        int32_t v = -70000 * ( seg + 1 ) + i;
+        raw.put( v );
+        fx.values[channel_path( 0 )].push_back( v );
+      }
+      for ( size_t i = 0; i < count; ++i ) {
+        float v = seg - i / 4.0f;
+        raw.put( v );
+        fx.values[channel_path( 1 )].push_back( v );
+      }
+      for ( size_t i = 0; i < count; ++i ) {
+        uint16_t v = 60000 + seg * 100 + i;
+        raw.put( v );
+        fx.values[channel_path( 2 )].push_back( v );
+      }
+      for ( size_t i = 0; i < count; ++i ) {
+        int64_t v = -( int64_t( 1 ) << 40 ) + seg * 1000 + i;
+        raw.put( v );
+        fx.values[channel_path( 3 )].push_back( v );
+      }
+      fx.add_segment( 0 == seg ? toc_new_obj_list : 0, meta, raw );
+    }
+    return fx;
+  }
+
+  /**
+   * A string channel next to a numeric one, in a group (and file) the
+   * file never mentions on their own
+   */
+  fixture strings( ) {
+    fixture fx;
+    fx.name = "strings";
+    const std::string text = "/'g'/'s'";
+    const std::string numbers = "/'g'/'n'";
+    fx.paths = { text, numbers };
+    const std::vector<std::vector<std::string>> texts = {
+      { "one", "", "three" },
+      { "\xc2\xb5V", "it's", "", "last" },
+      { "abc", "efg", "h", "ijkl" }
+    };
+    for ( size_t seg = 0; seg < texts.size( ); ++seg ) {
+      const auto& strs = texts[seg];
+      uint64_t size = strs.size( ) * 4;
+      for ( const auto& s : strs ) {
+        size += s.size( );
+      }
+      bytes meta;
+      // the last segment's strings take up as much room as the ones
+      // before, so it needs no metadata
+      if ( seg < 2 ) {
+        meta.put<uint32_t>( 2 );
+        string_object( meta, text, strs.size( ), size );
+        numeric_object( meta, numbers, tdsTypeI32, strs.size( ) );
+      }
+      bytes raw;
+      uint32_t end = 0;
+      for ( const auto& s : strs ) {
+        end += s.size( );
+        raw.put( end );
+      }
+      for ( const auto& s : strs ) {
+        raw.data += s;
+        fx.strings[text].push_back( s );
+      }
+      for ( size_t i = 0; i < strs.size( ); ++i ) {
+        int32_t v = seg * 10 + i;
+        raw.put( v );
+        fx.values[numbers].push_back( v );
+      }
+      fx.add_segment( 0 == seg ? toc_new_obj_list : 0, meta, raw );
+    }
+    return fx;
+  }
+
+  /**
+   * DAQmx data laid out the way DAQmx writes it: two raw buffers of
+   * interleaved rows, with a 16-bit channel, a 32-bit one and a float
+   * one, some of them scaled, and a digital line. Little-endian files
+   * use the raw data indexes as DAQmx writes them (the bytes
+   * 69 12 00 00 and 6A 12 00 00); the big-endian one spells them as
+   * NI's documentation does.
+   */
+  fixture daqmx( bool big ) {
+    fixture fx;
+    fx.name = ( big ? "daqmx_big_endian" : "daqmx" );
+    const std::vector<std::string> paths = {
+      "/'Dev1'", "/'Dev1'/'a'", "/'Dev1'/'b'", "/'Dev1'/'c'", "/'Dev1'/'d'"
+    };
+    fx.paths = paths;
+    const uint32_t scaler_index = ( big ? 0x69120000 : 0x00001269 );
+    const uint32_t digital_index = ( big ? 0x69130000 : 0x0000126A );
+    const std::vector<uint32_t> widths = { 6, 5 };
+    const size_t rows = 6;
+    auto linear = []( double slope, double intercept ) -> std::vector<property> {
+      return {
+        { "NI_Number_Of_Scales", tdsTypeU32, 1, "" },
+        { "NI_Scale[0]_Scale_Type", tdsTypeString, 0, "Linear" },
+        { "NI_Scale[0]_Linear_Slope", tdsTypeDoubleFloat, slope, "" },
+        { "NI_Scale[0]_Linear_Y_Intercept", tdsTypeDoubleFloat, intercept, "" },
+        { "NI_Scale[0]_Linear_Input_Source", tdsTypeU32, 4294967295.0, "" }
+      };
+    };
+    for ( size_t seg = 0; seg < 4; ++seg ) {
+      bytes meta;
+      meta.big = big;
+      if ( 0 == seg ) {
+        meta.put<uint32_t>( 5 );
+        no_data_object( meta, paths[0] );
+        // DAQmx types: 3 is I16, 5 is I32, 8 is SGL and 0 is U8
+        daqmx_object( meta, paths[1], scaler_index, rows, { 3, 0, 0, 0 }, widths, linear( 0.5, -3 ) );
+        // a polynomial scale claiming billions of coefficients is ignored
+        daqmx_object( meta, paths[2], scaler_index, rows, { 5, 0, 2, 0 }, widths, {
+          { "NI_Number_Of_Scales", tdsTypeU32, 1, "" },
+          { "NI_Scale[0]_Scale_Type", tdsTypeString, 0, "Polynomial" },
+          { "NI_Scale[0]_Polynomial_Coefficients_Size", tdsTypeU32, 4e9, "" },
+          { "NI_Scale[0]_Polynomial_Coefficients[0]", tdsTypeDoubleFloat, 5, "" }
+        } );
+        daqmx_object( meta, paths[3], scaler_index, rows, { 8, 1, 0, 0 }, widths, linear( 10, 1 ) );
+        daqmx_object( meta, paths[4], digital_index, rows, { 0, 1, 35, 0 }, widths, { } );
+      }
+      bytes raw;
+      raw.big = big;
+      for ( size_t r = 0; r < rows; ++r ) {
+        int16_t a = -300 + seg * 50 + r;
+        int32_t b = -( 1 << 20 ) + seg * 1000 + r;
+        raw.put( a ).put( b );
+        fx.values[paths[1]].push_back( 0.5 * a - 3 );
+        fx.values[paths[2]].push_back( b );
+        fx.unscaled[paths[1]].push_back( a );
+        fx.unscaled[paths[2]].push_back( b );
+      }
+      for ( size_t r = 0; r < rows; ++r ) {
+        float c = seg - r / 4.0f;
+        uint8_t lines = ( seg * 7 + r ) * 5;
+        raw.put( c ).put( lines );
+        fx.values[paths[3]].push_back( 10.0 * c + 1 );
+        fx.values[paths[4]].push_back( ( lines >> 3 ) & 1 );
+        fx.unscaled[paths[3]].push_back( c );
+        fx.unscaled[paths[4]].push_back( ( lines >> 3 ) & 1 );
+      }
+      fx.add_segment( toc_daqmx | ( 0 == seg ? toc_new_obj_list : 0 ), meta, raw );
+    }
+    const std::vector<double> raw_a = fx.unscaled[paths[1]];
+    fx.check_file = [raw_a, paths]( tdmsfile& f, const std::string& what ) {
+      // the raw values in their own type, which scaled ones can't be
+      std::vector<int16_t> a( raw_a.size( ) );
+      check( f[paths[1]]->read_all( a.data( ), a.size( ) ) == a.size( )
+          && std::equal( a.begin( ), a.end( ), raw_a.begin( ) ), what + ": DAQmx values as int16" );
+      bool thrown = false;
+      try {
+        f[paths[1]]->read_all( a.data( ), a.size( ), true );
+      }
+      catch ( std::runtime_error& ) {
+        thrown = true;
+      }
+      check( thrown, what + ": scaled DAQmx values as int16" );
+    };
+    return fx;
+  }
+
+  /**
+   * DAQmx objects with each of the raw data indexes there are, side by
+   * side in a little-endian file: 0x1269 and 0x126A as DAQmx writes
+   * them, and 0x69120000 and 0x69130000 as NI's documentation gives them
+   */
+  fixture daqmx_indexes( ) {
+    fixture fx;
+    fx.name = "daqmx_indexes";
+    const std::vector<std::string> paths = {
+      "/'Dev1'", "/'Dev1'/'a'", "/'Dev1'/'b'", "/'Dev1'/'c'", "/'Dev1'/'d'"
+    };
+    fx.paths = paths;
+    const std::vector<uint32_t> widths = { 6, 1 };
+    const size_t rows = 4;
+    for ( size_t seg = 0; seg < 3; ++seg ) {
+      bytes meta;
+      if ( 0 == seg ) {
+        meta.put<uint32_t>( 5 );
+        no_data_object( meta, paths[0] );
+        daqmx_object( meta, paths[1], 0x00001269, rows, { 3, 0, 0, 0 }, widths, { } );
+        daqmx_object( meta, paths[2], 0x69120000, rows, { 5, 0, 2, 0 }, widths, { } );
+        // digital lines, at bits 2 and 5 of the byte
+        daqmx_object( meta, paths[3], 0x0000126A, rows, { 0, 1, 2, 0 }, widths, { } );
+        daqmx_object( meta, paths[4], 0x69130000, rows, { 0, 1, 5, 0 }, widths, { } );
+      }
+      bytes raw;
+      for ( size_t r = 0; r < rows; ++r ) {
+        int16_t a = -100 + seg * 10 + r;
+        int32_t b = 70000 * ( seg + 1 ) - r;
+        raw.put( a ).put( b );
+        fx.values[paths[1]].push_back( a );
+        fx.values[paths[2]].push_back( b );
+      }
+      for ( size_t r = 0; r < rows; ++r ) {
+        uint8_t lines = ( seg * 5 + r ) * 13;
+        raw.put( lines );
+        fx.values[paths[3]].push_back( ( lines >> 2 ) & 1 );
+        fx.values[paths[4]].push_back( ( lines >> 5 ) & 1 );
+      }
+      fx.add_segment( toc_daqmx | ( 0 == seg ? toc_new_obj_list : 0 ), meta, raw );
+    }
+    return fx;
+  }
+
+  /**
+   * Extended float channels, with and without a unit, holding values that
+   * round every way a double can
+   */
+  fixture extended_floats( ) {
+    fixture fx;
+    fx.name = "extended";
+    const std::string plain = "/'g'/'e'";
+    const std::string with_unit = "/'g'/'u'";
+    fx.paths = { "/'g'", plain, with_unit };
+    const size_t count = extended_values.size( );
+    for ( size_t seg = 0; seg < 3; ++seg ) {
+      bytes meta;
+      if ( 0 == seg ) {
+        meta.put<uint32_t>( 3 );
+        no_data_object( meta, "/'g'" );
+        numeric_object( meta, plain, tdsTypeExtendedFloat, count );
+        numeric_object( meta, with_unit, tdsTypeExtendedFloatWithUnit, count );
+      }
+      bytes raw;
+      for ( size_t i = 0; i < count; ++i ) {
+        const auto& v = extended_values[( i + seg ) % count];
+        raw.data += v.first;
+        fx.values[plain].push_back( v.second );
+      }
+      for ( size_t i = 0; i < count; ++i ) {
+        const auto& v = extended_values[count - 1 - i];
+        raw.data += v.first;
+        fx.values[with_unit].push_back( v.second );
+      }
+      fx.add_segment( 0 == seg ? toc_new_obj_list : 0, meta, raw );
+    }
+    return fx;
+  }
+
+  /**
+   * Single and double float channels with units, the double one scaled by
+   * properties that have units too
+   */
+  fixture units( ) {
+    fixture fx;
+    fx.name = "units";
+    const std::string singles = "/'g'/'s'";
+    const std::string doubles = "/'g'/'d'";
+    fx.paths = { "/'g'", singles, doubles };
+    // enough for the vectorized kernels, and some left over
+    const size_t rows = 37;
+    std::vector<double> scaled;
+    for ( size_t seg = 0; seg < 3; ++seg ) {
+      bytes meta;
+      if ( 0 == seg ) {
+        meta.put<uint32_t>( 3 );
+        no_data_object( meta, "/'g'", { { "gain", tdsTypeDoubleFloatWithUnit, 2.5, "" } } );
+        numeric_object( meta, singles, tdsTypeSingleFloatWithUnit, rows );
+        numeric_object( meta, doubles, tdsTypeDoubleFloatWithUnit, rows, {
+          { "NI_Number_Of_Scales", tdsTypeU32, 1, "" },
+          { "NI_Scale[0]_Scale_Type", tdsTypeString, 0, "Linear" },
+          { "NI_Scale[0]_Linear_Slope", tdsTypeSingleFloatWithUnit, 0.5, "" },
+          { "NI_Scale[0]_Linear_Y_Intercept", tdsTypeDoubleFloatWithUnit, -3, "" }
+        } );
+      }
+      bytes raw;
+      for ( size_t r = 0; r < rows; ++r ) {
+        float v = seg * 100.0f - r * 2.75f;
+        raw.put( v );
+        fx.values[singles].push_back( v );
+      }
+      for ( size_t r = 0; r < rows; ++r ) {
+        double v = seg * 1e6 + r / 4.0;
+        raw.put( v );
+        fx.values[doubles].push_back( v );
+        scaled.push_back( 0.5 * v - 3 );
+      }
+      fx.add_segment( 0 == seg ? toc_new_obj_list : 0, meta, raw );
+    }
+    const auto values = fx.values;
+    fx.check_file = [values, scaled, singles, doubles]( tdmsfile& f, const std::string& what ) {
+      auto properties = f["/'g'"]->get_properties( );
+      check( properties.end( ) != properties.find( "gain" ) && 2.5 == properties.at( "gain" )->asDouble( ),
+          what + ": property with a unit" );
+
+      auto got = f[doubles]->read_all<double>( true );
+      check( got.size( ) == scaled.size( ) && std::equal( got.begin( ), got.end( ), scaled.begin( ) ),
+          what + ": scaled doubles with units" );
+
+      // narrowed, and widened
+      const std::vector<double>& expected = values.at( singles );
+      std::vector<int16_t> shorts( expected.size( ) );
+      f[singles]->read_all( shorts.data( ), shorts.size( ) );
+      auto widened = f[singles]->read_all<double>( );
+      for ( size_t i = 0; i < expected.size( ); ++i ) {
+        check( shorts[i] == (int16_t) expected[i], what + ": float with a unit " + std::to_string( i ) + " as int16" );
+        check( widened[i] == expected[i], what + ": float with a unit " + std::to_string( i ) + " as double" );
+      }
+    };
+    return fx;
+  }
+
+  void check_extended_kernel( ) {
+    std::string src;
+    for ( const auto& v : extended_values ) {
+      src += v.first;
+    }
+    std::vector<double> got( extended_values.size( ) );
+    extended_to_double( (const unsigned char *) src.data( ), got.size( ), got.data( ) );
+    for ( size_t i = 0; i < got.size( ); ++i ) {
+      // bit for bit, so the signs of zeros count
+      check( 0 == memcmp( &got[i], &extended_values[i].second, sizeof ( double ) ),
+          "extended_to_double of value " + std::to_string( i ) );
+    }
+
+    double nan;
+    std::string quiet = extended( false, 0x7FFF, 0xC000000000000000 );
+    extended_to_double( (const unsigned char *) quiet.data( ), 1, &nan );
+    check( std::isnan( nan ), "extended_to_double of a NaN" );
+  }
+
+  /**
+   * A timestamp channel next to a double one, in a group with a timestamp
+   * property
+   */
+  fixture timestamps( ) {
+    fixture fx;
+    fx.name = "timestamps";
+    const std::string times = "/'g'/'t'";
+    const std::string numbers = "/'g'/'n'";
+    fx.paths = { "/'g'", times, numbers };
+    const timestamp_value& start = timestamp_values[2];
+    for ( size_t seg = 0; seg < 3; ++seg ) {
+      bytes meta;
+      if ( 0 == seg ) {
+        meta.put<uint32_t>( 3 );
+        no_data_object( meta, "/'g'",
+            { { "start", tdsTypeTimeStamp, 0, "", start.fraction, start.seconds } } );
+        numeric_object( meta, times, tdsTypeTimeStamp, timestamp_values.size( ) );
+        numeric_object( meta, numbers, tdsTypeDoubleFloat, timestamp_values.size( ) );
+      }
+      bytes raw;
+      raw.data += timestamps_as_stored( );
+      for ( const auto& t : timestamp_values ) {
+        fx.values[times].push_back( t.unix_seconds );
+      }
+      for ( size_t i = 0; i < timestamp_values.size( ); ++i ) {
+        raw.put( seg + i / 2.0 );
+        fx.values[numbers].push_back( seg + i / 2.0 );
+      }
+      fx.add_segment( 0 == seg ? toc_new_obj_list : 0, meta, raw );
+    }
+    fx.check_file = [start]( tdmsfile& f, const std::string& what ) {
+      auto properties = f["/'g'"]->get_properties( );
+      if ( properties.end( ) == properties.find( "start" ) ) {
+        check( false, what + ": no start property" );
+        return;
+      }
+      const channel::property& p = *properties.at( "start" );
+      const timestamp& t = p.asTimestamp( );
+      check( t.seconds == start.seconds && t.fraction == start.fraction, what + ": start property" );
+      check( p.asUTCTimestamp( ) == 1700000000 && t.unix_time( ) == 1700000000,
+          what + ": start property in Unix time" );
+      check( t.nanoseconds( ) == start.unix_nanoseconds && t.unix_seconds( ) == start.unix_seconds,
+          what + ": start property in nanoseconds and seconds" );
+    };
+    return fx;
+  }
+
+  /**
+   * Channels with NI_Scale properties but no DAQmx data: a linear scale,
+   * a polynomial feeding a linear one, a scale on values the properties
+   * say are already scaled, and no scale at all. The loaders deliver the
+   * raw values; read_into scales them when asked to.
+   */
+  fixture scales( ) {
+    fixture fx;
+    fx.name = "scaling";
+    const std::string linear = "/'g'/'l'";
+    const std::string chained = "/'g'/'p'";
+    const std::string floats = "/'g'/'f'";
+    const std::string done = "/'g'/'s'";
+    const std::string plain = "/'g'/'u'";
+    fx.paths = { "/'g'", linear, chained, floats, done, plain };
+    // enough for the vectorized kernels, and some left over
+    const size_t rows = 37;
+    auto linear_scale = []( size_t n, double slope, double intercept, double input ) -> std::vector<property> {
+      std::string prefix = "NI_Scale[" + std::to_string( n ) + "]_";
+      return {
+        { prefix + "Scale_Type", tdsTypeString, 0, "Linear" },
+        { prefix + "Linear_Slope", tdsTypeDoubleFloat, slope, "" },
+        { prefix + "Linear_Y_Intercept", tdsTypeDoubleFloat, intercept, "" },
+        { prefix + "Linear_Input_Source", tdsTypeU32, input, "" }
+      };
+    };
+    auto with = []( std::vector<property> properties, const std::vector<property>& more ) {
+      properties.insert( properties.end( ), more.begin( ), more.end( ) );
+      return properties;
+    };
+    std::map<std::string, std::vector<double>> scaled;
+    for ( size_t seg = 0; seg < 3; ++seg ) {
+      bytes meta;
+      if ( 0 == seg ) {
+        meta.put<uint32_t>( 6 );
+        no_data_object( meta, "/'g'" );
+        numeric_object( meta, linear, tdsTypeI16, rows, with( linear_scale( 0, 0.5, -3, 4294967295.0 ), {
+          { "NI_Number_Of_Scales", tdsTypeU32, 1, "" }
+        } ) );
+        // 2 * ( 1 + 2x + 0.5x^2 ) + 1, which is 3 + 4x + x^2
+        numeric_object( meta, chained, tdsTypeI32, rows, with( linear_scale( 1, 2, 1, 0 ), {
+          { "NI_Number_Of_Scales", tdsTypeU32, 2, "" },
+          { "NI_Scale[0]_Scale_Type", tdsTypeString, 0, "Polynomial" },
+          { "NI_Scale[0]_Polynomial_Coefficients_Size", tdsTypeU32, 3, "" },
+          { "NI_Scale[0]_Polynomial_Coefficients[0]", tdsTypeDoubleFloat, 1, "" },
+          { "NI_Scale[0]_Polynomial_Coefficients[1]", tdsTypeDoubleFloat, 2, "" },
+          { "NI_Scale[0]_Polynomial_Coefficients[2]", tdsTypeDoubleFloat, 0.5, "" },
+          { "NI_Scale[0]_Polynomial_Input_Source", tdsTypeU32, 4294967295.0, "" }
+        } ) );
+        numeric_object( meta, floats, tdsTypeSingleFloat, rows, with( linear_scale( 0, 10, 1, 4294967295.0 ), {
+          { "NI_Number_Of_Scales", tdsTypeU32, 1, "" }
+        } ) );
+        numeric_object( meta, done, tdsTypeDoubleFloat, rows, with( linear_scale( 0, 10, 1, 4294967295.0 ), {
+          { "NI_Number_Of_Scales", tdsTypeU32, 1, "" },
+          { "NI_Scaling_Status", tdsTypeString, 0, "scaled" }
+        } ) );
+        numeric_object( meta, plain, tdsTypeU8, rows );
+      }
+      bytes raw;
+      for ( size_t r = 0; r < rows; ++r ) {
+        int16_t l = -300 + seg * 50 + r;
+        raw.put( l );
+        fx.values[linear].push_back( l );
+        scaled[linear].push_back( 0.5 * l - 3 );
+      }
+      for ( size_t r = 0; r < rows; ++r ) {
+        int32_t p = (int32_t) ( seg * rows + r ) - 50;
+        raw.put( p );
+        fx.values[chained].push_back( p );
+        scaled[chained].push_back( 3.0 + 4.0 * p + (double) p * p );
+      }
+      for ( size_t r = 0; r < rows; ++r ) {
+        float f = seg - r / 4.0f;
+        raw.put( f );
+        fx.values[floats].push_back( f );
+        scaled[floats].push_back( 10.0 * f + 1 );
+      }
+      for ( size_t r = 0; r < rows; ++r ) {
+        double d = seg * 1000.0 + r / 8.0;
+        raw.put( d );
+        fx.values[done].push_back( d );
+        scaled[done].push_back( d );
+      }
+      for ( size_t r = 0; r < rows; ++r ) {
+        uint8_t u = seg * 80 + r;
+        raw.put( u );
+        fx.values[plain].push_back( u );
+        scaled[plain].push_back( u );
+      }
+      fx.add_segment( 0 == seg ? toc_new_obj_list : 0, meta, raw );
+    }
+    const auto raw_values = fx.values;
+    fx.check_file = [scaled, raw_values, floats]( tdmsfile& f, const std::string& what ) {
+      for ( const auto& expected : scaled ) {
+        channel * ch = f[expected.first];
+        std::string which = what + ": " + expected.first;
+        auto doubles = ch->read_all<double>( true );
+        auto singles = ch->read_all<float>( true );
+        check( doubles.size( ) == expected.second.size( ) && singles.size( ) == expected.second.size( ),
+            which + " number of scaled values" );
+        for ( size_t i = 0; i < std::min( doubles.size( ), expected.second.size( ) ); ++i ) {
+          check( doubles[i] == expected.second[i], which + " scaled value " + std::to_string( i ) );
+        }
+        for ( size_t i = 0; i < std::min( singles.size( ), expected.second.size( ) ); ++i ) {
+          check( singles[i] == (float) expected.second[i], which + " scaled float " + std::to_string( i ) );
+        }
+
+        // a range in the middle of the second segment
+        const std::vector<double>& raw = raw_values.at( expected.first );
+        std::vector<double> part( 10 );
+        check( ch->read_into( 40, part.data( ), part.size( ), true ) == part.size( ), which + " scaled range" );
+        check( std::equal( part.begin( ), part.end( ), expected.second.begin( ) + 40 ), which + " scaled range values" );
+
+        std::vector<int32_t> ints( raw.size( ) );
+        try {
+          ch->read_all( ints.data( ), ints.size( ), true );
+          check( expected.first == "/'g'/'u'" || expected.first == "/'g'/'s'",
+              which + " scaled values read as integers" );
+        }
+        catch ( std::runtime_error& ) {
+        }
+        ch->read_all( ints.data( ), ints.size( ) );
+        for ( size_t i = 0; i < raw.size( ); ++i ) {
+          check( ints[i] == (int32_t) raw[i], which + " value " + std::to_string( i ) + " as int32" );
+        }
+      }
+
+      // narrowing floats saturates at the ends of the range
+      std::vector<uint8_t> bytes( raw_values.at( floats ).size( ) );
+      f[floats]->read_all( bytes.data( ), bytes.size( ) );
+      for ( size_t i = 0; i < bytes.size( ); ++i ) {
+        double v = raw_values.at( floats )[i];
+        check( bytes[i] == ( v <= 0 ? 0 : (uint8_t) v ), what + ": float value " + std::to_string( i ) + " as uint8" );
+      }
+    };
+    return fx;
+  }
+
+  void check_timestamp_kernels( ) {
+    // enough for the vectorized kernels, and one left over
+    std::string src = timestamps_as_stored( );
+    size_t count = timestamp_values.size( );
+    std::vector<int64_t> ns( count );
+    std::vector<double> seconds( count );
+    timestamps_to_nanoseconds( (const unsigned char *) src.data( ), count, ns.data( ) );
+    timestamps_to_seconds( (const unsigned char *) src.data( ), count, seconds.data( ) );
+    for ( size_t i = 0; i < count; ++i ) {
+      const timestamp_value& t = timestamp_values[i];
+      check( ns[i] == t.unix_nanoseconds, "timestamps_to_nanoseconds of value " + std::to_string( i ) );
+      check( seconds[i] == t.unix_seconds, "timestamps_to_seconds of value " + std::to_string( i ) );
+      timestamp one{ t.fraction, t.seconds };
+      check( one.nanoseconds( ) == t.unix_nanoseconds && one.unix_seconds( ) == t.unix_seconds
+          && one.unix_time( ) == t.seconds - epoch_1904, "timestamp of value " + std::to_string( i ) );
+    }
+  }
+
+  // the values each conversion starts from, once narrowed to the source
+  // type: fractions, both zeros, the ends of every integer type, and
+  // values past them
+  const std::vector<double> conversion_values = {
+    0.0, -0.0, 1.0, -1.0, 3.7, -3.7, 0.5, -0.5, 127.5, -128.9, 200.0, 255.99, 300.0, -300.0,
+    32767.5, -32769.0, 40000.25, 65535.0, 70000.0, -70000.0, 2147483647.5, -2147483649.0,
+    4294967295.0, 4294967296.0, 1e10, -1e10, 9007199254740992.0, 9.3e18, -9.3e18, 1.8e19,
+    1e20, -1e20, 3e38, 1e39, -1e39, 1e-40, INFINITY, -INFINITY, NAN
+  };
+
+  // what convert is documented to do with a single value
+  template<typename To, typename From>
+  To converted( From value ) {
+    if constexpr ( std::is_floating_point<From>::value && std::is_integral<To>::value ) {
+      if ( value != value ) {
+        return 0;
+      }
+      if ( value <= (From) std::numeric_limits<To>::min( ) ) {
+        return std::numeric_limits<To>::min( );
+      }
+      if ( value >= (From) std::numeric_limits<To>::max( ) ) {
+        return std::numeric_limits<To>::max( );
+      }
+    }
+    return (To) value;
+  }
+
+  template<typename T>
+  bool same_value( T a, T b ) {
+    if constexpr ( std::is_floating_point<T>::value ) {
+      if ( a != a && b != b ) {
+        return true;
+      }
+    }
+    return a == b;
+  }
+
+  template<typename From>
+  std::vector<From> conversion_sources( ) {
+    std::vector<From> values;
+    for ( double v : conversion_values ) {
+      values.push_back( converted<From>( v ) );
+    }
+    if constexpr ( sizeof ( From ) == 8 && std::is_integral<From>::value ) {
+      // ones a double can't hold, which have to round the right way
+      for ( uint64_t v : { 0x7FFFFFFFFFFFFFFFull, 0x8000000000000000ull, 0xFFFFFFFFFFFFFFFFull,
+          ( 1ull << 53 ) + 1, ( 1ull << 53 ) + 3, ( 1ull << 24 ) + 1, 0xFFFFFFFFFFFFFBFFull } ) {
+        values.push_back( (From) v );
+      }
+    }
+    return values;
+  }
+
+  template<typename From, typename To>
+  void check_conversion( ) {
+    std::vector<From> src = conversion_sources<From>( );
+    std::vector<To> dst( src.size( ) );
+    std::string what = "converting " + data_type_t( tds_type<From>::code ).name( ) + " to "
+        + data_type_t( tds_type<To>::code ).name( );
+    convert( (const unsigned char *) src.data( ), tds_type<From>::code, src.size( ), dst.data( ), tds_type<To>::code );
+    for ( size_t i = 0; i < src.size( ); ++i ) {
+      check( same_value( dst[i], converted<To>( src[i] ) ), what + ", value " + std::to_string( i ) );
+    }
+  }
+
+  template<typename From>
+  void check_conversions_from( ) {
+    check_conversion<From, int8_t>( );
+    check_conversion<From, int16_t>( );
+    check_conversion<From, int32_t>( );
+    check_conversion<From, int64_t>( );
+    check_conversion<From, uint8_t>( );
+    check_conversion<From, uint16_t>( );
+    check_conversion<From, uint32_t>( );
+    check_conversion<From, uint64_t>( );
+    check_conversion<From, float>( );
+    check_conversion<From, double>( );
+  }
+
+  template<typename To>
+  void check_extended_conversion( ) {
+    std::string src;
+    for ( const auto& v : extended_values ) {
+      src += v.first;
+    }
+    std::vector<To> dst( extended_values.size( ) );
+    convert( (const unsigned char *) src.data( ), tdsTypeExtendedFloat, dst.size( ), dst.data( ), tds_type<To>::code );
+    for ( size_t i = 0; i < dst.size( ); ++i ) {
+      check( same_value( dst[i], converted<To>( extended_values[i].second ) ),
+          "converting extended floats to " + data_type_t( tds_type<To>::code ).name( ) + ", value " + std::to_string( i ) );
+    }
+  }
+
+  void check_conversions( ) {
+    check_conversions_from<int8_t>( );
+    check_conversions_from<int16_t>( );
+    check_conversions_from<int32_t>( );
+    check_conversions_from<int64_t>( );
+    check_conversions_from<uint8_t>( );
+    check_conversions_from<uint16_t>( );
+    check_conversions_from<uint32_t>( );
+    check_conversions_from<uint64_t>( );
+    check_conversions_from<float>( );
+    check_conversions_from<double>( );
+    check_extended_conversion<int32_t>( );
+    check_extended_conversion<uint64_t>( );
+    check_extended_conversion<float>( );
+    check_extended_conversion<double>( );
+
+    // strings and timestamps aren't numbers
+    double d;
+    for ( tds_type_code from : { tdsTypeString, tdsTypeTimeStamp, tdsTypeBoolean } ) {
+      try {
+        convert( (const unsigned char *) "", from, 0, &d, tdsTypeDoubleFloat );
+        check( false, "converting " + data_type_t( from ).name( ) + " values" );
+      }
+      catch ( std::runtime_error& ) {
+      }
+    }
+  }
+
+  template<typename T>
+  double value_as_double( const unsigned char * raw, size_t i ) {
+    T v;
+    memcpy( &v, raw + i * sizeof ( T ), sizeof ( T ) );
+    return v;
+  }
+
+  double value_at( const unsigned char * raw, data_type_t type, size_t i ) {
+    switch ( type.code( ) ) {
+      case tdsTypeI8: return value_as_double<int8_t>( raw, i );
+      case tdsTypeI16: return value_as_double<int16_t>( raw, i );
+      case tdsTypeI32: return value_as_double<int32_t>( raw, i );
+      case tdsTypeI64: return value_as_double<int64_t>( raw, i );
+      case tdsTypeU8: return value_as_double<uint8_t>( raw, i );
+      case tdsTypeU16: return value_as_double<uint16_t>( raw, i );
+      case tdsTypeU32: return value_as_double<uint32_t>( raw, i );
+      case tdsTypeU64: return value_as_double<uint64_t>( raw, i );
+      case tdsTypeSingleFloat:
+      case tdsTypeSingleFloatWithUnit: return value_as_double<float>( raw, i );
+      case tdsTypeDoubleFloat:
+      case tdsTypeDoubleFloatWithUnit: return value_as_double<double>( raw, i );
+      case tdsTypeExtendedFloat:
+      case tdsTypeExtendedFloatWithUnit:
+      {
+        double v;
+        extended_to_double( raw + i * 16, 1, &v );
+        return v;
+      }
+      case tdsTypeTimeStamp:
+      {
+        double v;
+        timestamps_to_seconds( raw + i * 16, 1, &v );
+        return v;
+      }
+      default:
+        throw std::runtime_error( "Unexpected data type " + type.name( ) );
+    }
+  }
+
+  /**
+   * Keeps every value it is handed, by channel
+   */
+  class collector : public listener {
+  public:
+    std::map<std::string, std::vector<double>> values;
+    std::map<std::string, std::vector<std::string>> strings;
+    // the bytes data( ) got, as they were handed over
+    std::map<std::string, std::string> stored;
+
+    void data( const std::string& channelname, const unsigned char* rawdata,
+        data_type_t type, size_t num_vals ) override {
+      auto& v = values[channelname];
+      for ( size_t i = 0; i < num_vals; ++i ) {
+        v.push_back( value_at( rawdata, type, i ) );
+      }
+      stored[channelname].append( (const char *) rawdata, num_vals * type.length( ) );
+    }
+
+    void segment_data( size_t segnum, const std::string& channelname,
+        const unsigned char* rawdata, data_type_t type, size_t num_vals ) override {
+      std::lock_guard<std::mutex> lock( _lock );
+      auto& v = _segment_values[segnum][channelname];
+      for ( size_t i = 0; i < num_vals; ++i ) {
+        v.push_back( value_at( rawdata, type, i ) );
+      }
+    }
+
+    void string_data( const std::string& channelname, const std::string_view* values,
+        size_t num_vals ) override {
+      strings[channelname].insert( strings[channelname].end( ), values, values + num_vals );
+    }
+
+    void segment_string_data( size_t segnum, const std::string& channelname,
+        const std::string_view* values, size_t num_vals ) override {
+      std::lock_guard<std::mutex> lock( _lock );
+      auto& v = _segment_strings[segnum][channelname];
+      v.insert( v.end( ), values, values + num_vals );
+    }
+
+    // puts what segment_data( ) got in file order
+    void flatten( ) {
+      for ( const auto& seg : _segment_values ) {
+        for ( const auto& ch : seg.second ) {
+          values[ch.first].insert( values[ch.first].end( ), ch.second.begin( ), ch.second.end( ) );
+        }
+      }
+      for ( const auto& seg : _segment_strings ) {
+        for ( const auto& ch : seg.second ) {
+          strings[ch.first].insert( strings[ch.first].end( ), ch.second.begin( ), ch.second.end( ) );
+        }
+      }
+    }
+
+  private:
+    std::mutex _lock;
+    std::map<size_t, std::map<std::string, std::vector<double>>> _segment_values;
+    std::map<size_t, std::map<std::string, std::vector<std::string>>> _segment_strings;
+  };
+
+  struct variant {
+    std::string name;
+    open_options opts;
+  };
+
+  std::vector<variant> variants( const std::string& directory ) {
+    std::vector<variant> all;
+    auto add = [&]( const std::string& name, const std::function<void( open_options& )>& set ) {
+      open_options opts;
+      set( opts );
+      all.push_back( { name, opts } );
+    };
+    add( "default", [](open_options& ) { } );
+    add( "mmap", [](open_options & o ) {
+      o.memory_map = true;
+    } );
+    add( "no-index", [](open_options & o ) {
+      o.use_index = false;
+    } );
+    add( "lazy", [](open_options & o ) {
+      o.lazy_metadata = true;
+    } );
+    add( "lazy-mmap", [](open_options & o ) {
+      o.lazy_metadata = true;
+      o.memory_map = true;
+    } );
+    add( "threads", [](open_options & o ) {
+      o.metadata_threads = 4;
+    } );
+    add( "lazy-threads", [](open_options & o ) {
+      o.lazy_metadata = true;
+      o.metadata_threads = 4;
+    } );
+    add( "io-queue", [](open_options & o ) {
+      o.io_queue_depth = 8;
+    } );
+    add( "io-queue-scan", [](open_options & o ) {
+      o.io_queue_depth = 8;
+      o.use_index = false;
+    } );
+    add( "sampling", [](open_options & o ) {
+      o.use_index = false;
+      o.leadin_sampling = 3;
+    } );
+    add( "io-queue-sampling", [](open_options & o ) {
+      o.io_queue_depth = 3;
+      o.use_index = false;
+      o.leadin_sampling = 2;
+    } );
+    // room for a couple of values at a time, and for a few segments
+    add( "small-buffers", [](open_options & o ) {
+      o.max_buffer_size = 20;
+    } );
+    add( "buffers", [](open_options & o ) {
+      o.max_buffer_size = 700;
+    } );
+    // the first file opened writes the snapshot, and the rest read it
+    add( "cache", [&directory](open_options & o ) {
+      o.use_cache = true;
+      o.cache_directory = directory;
+    } );
+    return all;
+  }
+
+  std::vector<channel *> channels_with_data( tdmsfile& f ) {
+    std::vector<channel *> channels;
+    for ( channel * ch : f ) {
+      if ( ch->number_values( ) > 0 ) {
+        channels.push_back( ch );
+      }
+    }
+    return channels;
+  }
+
+  const std::vector<std::string> loaders = {
+    "segment", "ordered", "unordered", "prefetch", "prefetch-bytes", "channels", "selected"
+  };
+
+  void load( tdmsfile& f, const std::string& how, collector& c ) {
+    if ( "segment" == how ) {
+      for ( size_t i = 0; i < f.segments( ); ++i ) {
+        f.loadSegment( i, &c );
+      }
+    }
+    else if ( "ordered" == how ) {
+      f.loadSegments( 0, f.segments( ), &c, 3, true );
+    }
+    else if ( "unordered" == how ) {
+      f.loadSegments( 0, f.segments( ), &c, 3, false );
+      c.flatten( );
+    }
+    else if ( "prefetch" == how ) {
+      prefetching_loader( f, 3 ).load_all( &c );
+    }
+    else if ( "prefetch-bytes" == how ) {
+      prefetching_loader( f, 4, 64 ).load_all( &c );
+    }
+    else if ( "channels" == how ) {
+      f.loadChannels( channels_with_data( f ), &c );
+    }
+    else if ( "selected" == how ) {
+      for ( channel * ch : channels_with_data( f ) ) {
+        for ( size_t i = 0; i < f.segments( ); ++i ) {
+          f.loadSegment( i, &c, { ch } );
+        }
+      }
+    }
+  }
+
+  template<typename T>
+  void check_values( const std::map<std::string, std::vector<T>>& expected,
+      const std::map<std::string, std::vector<T>>& got, const std::string& what ) {
+    for ( const auto& ch : expected ) {
+      auto it = got.find( ch.first );
+      if ( got.end( ) == it ) {
+        check( false, what + ": no values for " + ch.first );
+        continue;
+      }
+      check( ch.second.size( ) == it->second.size( ), what + ": " + ch.first + " has "
+          + std::to_string( it->second.size( ) ) + " values, not " + std::to_string( ch.second.size( ) ) );
+      for ( size_t i = 0; i < std::min( ch.second.size( ), it->second.size( ) ); ++i ) {
+        if ( ch.second[i] != it->second[i] ) {
+          check( false, what + ": " + ch.first + " differs at value " + std::to_string( i ) );
+          break;
+        }
+      }
+    }
+    check( expected.size( ) == got.size( ), what + ": values for channels that weren't written" );
+  }
+
+  // checks tdmsfile::read against the bytes loading the file gave
+  void check_ranges( tdmsfile& f, const collector& loaded, const std::string& what ) {
+    for ( const auto& ch : loaded.stored ) {
+      channel * c = f[ch.first];
+      if ( data_type_t( tdsTypeDAQmxRawData ).name( ) == c->data_type( ) ) {
+        // DAQmx values are scaled, so they aren't read as they're stored
+        continue;
+      }
+      size_t count = c->number_values( );
+      if ( 0 == count || ch.second.size( ) % count != 0 ) {
+        check( false, what + ": number of values of " + ch.first );
+        continue;
+      }
+      size_t size = ch.second.size( ) / count;
+      std::string out( ch.second.size( ), '\0' );
+      check( f.read( c, 0, count, &out[0] ) == count && out == ch.second, what + ": all of " + ch.first );
+
+      // a range across segments, one running off the end, and one past it
+      size_t start = std::min<size_t>( 3, count - 1 );
+      size_t n = f.read( c, start, 9, &out[0] );
+      check( n == std::min<size_t>( 9, count - start )
+          && 0 == memcmp( out.data( ), ch.second.data( ) + start * size, n * size ),
+          what + ": range of " + ch.first );
+      n = f.read( c, count - 1, 5, &out[0] );
+      check( 1 == n && 0 == memcmp( out.data( ), ch.second.data( ) + ( count - 1 ) * size, size ),
+          what + ": range at the end of " + ch.first );
+      check( 0 == f.read( c, count, 5, &out[0] ), what + ": range past the end of " + ch.first );
+    }
+  }
+
+  // reads the channel's values with read_all( ), as doubles
+  std::vector<double> read_all( channel * c, bool scaled = false ) {
+    if ( data_type_t( tdsTypeTimeStamp ).name( ) == c->data_type( ) ) {
+      std::vector<double> seconds;
+      for ( const timestamp& t : c->read_all<timestamp>( ) ) {
+        seconds.push_back( t.unix_seconds( ) );
+      }
+      return seconds;
+    }
+    auto all = c->read_all<double>( scaled );
+    return std::vector<double>( all.begin( ), all.end( ) );
+  }
+
+  void check_reads( tdmsfile& f, const fixture& fx, const std::string& what ) {
+    for ( const auto& ch : fx.values ) {
+      channel * c = f[ch.first];
+      bool scales = ( fx.unscaled.end( ) != fx.unscaled.find( ch.first ) );
+      const std::vector<double>& raw = ( scales ? fx.unscaled.at( ch.first ) : ch.second );
+      check( c->number_values( ) == ch.second.size( ), what + ": number of values of " + ch.first );
+      check( read_all( c ) == raw, what + ": read_all of " + ch.first );
+      if ( scales ) {
+        check( read_all( c, true ) == ch.second, what + ": scaled read_all of " + ch.first );
+      }
+      if ( data_type_t( tdsTypeTimeStamp ).name( ) == c->data_type( ) ) {
+        continue;
+      }
+
+      // a range across segments, and one running off the end
+      std::vector<double> some( 5 );
+      size_t start = std::min<size_t>( 2, ch.second.size( ) );
+      size_t n = c->read_into( start, some.data( ), some.size( ) );
+      size_t expected_n = std::min( some.size( ), ch.second.size( ) - start );
+      check( n == expected_n && std::equal( some.begin( ), some.begin( ) + n, raw.begin( ) + start ),
+          what + ": read_into of " + ch.first );
+      if ( scales ) {
+        n = c->read_into( start, some.data( ), some.size( ), true );
+        check( n == expected_n && std::equal( some.begin( ), some.begin( ) + n, ch.second.begin( ) + start ),
+            what + ": scaled read_into of " + ch.first );
+      }
+      n = c->read_into( ch.second.size( ) - 1, some.data( ), some.size( ) );
+      check( 1 == n && some[0] == raw.back( ), what + ": read_into at the end of " + ch.first );
+
+      // a buffer that's too small
+      bool thrown = false;
+      std::vector<double> all( ch.second.size( ) );
+      try {
+        c->read_all( all.data( ), all.size( ) - 1 );
+      }
+      catch ( std::length_error& ) {
+        thrown = true;
+      }
+      check( thrown, what + ": read_all into too small a buffer for " + ch.first );
+    }
+  }
+
+  void check_ids( tdmsfile& f, const std::string& what ) {
+    for ( size_t id = 0; id < f.channel_count( ); ++id ) {
+      channel * ch = f.channel_by_id( id );
+      check( ch->id( ) == id, what + ": ID " + std::to_string( id ) );
+      check( ch == f.find_object( ch->get_path( ) ) && ch == f[ch->get_path( )],
+          what + ": looking up " + ch->get_path( ) );
+    }
+    check( nullptr == f.find_object( "/'no such group'" ), what + ": looking up a missing object" );
+    bool thrown = false;
+    try {
+      f.channel_by_id( f.channel_count( ) );
+    }
+    catch ( std::out_of_range& ) {
+      thrown = true;
+    }
+    check( thrown, what + ": an ID past the end" );
+  }
+
+  void check_tree( tdmsfile& f, const fixture& fx, const std::string& what ) {
+    std::vector<std::string> mentioned;
+    for ( channel * ch : f ) {
+      check( !ch->made_up( ), what + ": iterating visits made-up " + ch->get_path( ) );
+      mentioned.push_back( ch->get_path( ) );
+    }
+    check( mentioned == fx.paths, what + ": objects aren't in file order" );
+
+    channel * root = f.root( );
+    bool written = ( fx.paths.end( ) != std::find( fx.paths.begin( ), fx.paths.end( ), "/" ) );
+    check( nullptr != root && "/" == root->get_path( ) && nullptr == root->parent( )
+        && written != root->made_up( ), what + ": root" );
+
+    std::vector<std::string> names;
+    for ( const auto& path : fx.paths ) {
+      if ( !split_path( path, names ) || names.size( ) != 2 ) {
+        continue;
+      }
+      channel * ch = f.find_channel( names[0], names[1] );
+      check( nullptr != ch && ch->get_path( ) == path, what + ": find_channel for " + path );
+      channel * group = f.find_group( names[0] );
+      check( nullptr != ch && nullptr != group && group == ch->parent( ) && ch == group->child( names[1] ),
+          what + ": group of " + path );
+      check( nullptr != group && nullptr != root && root == group->parent( )
+          && group == root->child( names[0] ), what + ": root of " + path );
+    }
+    check( nullptr == f.find_channel( "g", "no such channel" ) && nullptr == f.find_group( "no such group" ),
+        what + ": finding missing objects" );
+  }
+
+  void run( const fixture& fx, const std::string& directory ) {
+    std::string filename = directory + "/" + fx.name + ".tdms";
+    fx.write( filename, fx.segments.size( ) );
+
+    for ( const auto& v : variants( directory ) ) {
+      if ( !fx.runs_alike && v.opts.leadin_sampling > 1 ) {
+        continue;
+      }
+      for ( const auto& how : loaders ) {
+        std::string what = fx.name + " " + v.name + " " + how;
+        try {
+          tdmsfile f( filename, v.opts );
+          check( f.segments( ) == fx.segments.size( ), what + ": number of segments" );
+          collector c;
+          load( f, how, c );
+          check_values( fx.values, c.values, what );
+          check_values( fx.strings, c.strings, what );
+        }
+        catch ( std::exception& e ) {
+          check( false, what + ": " + e.what( ) );
+        }
+      }
+
+      std::string what = fx.name + " " + v.name + " reads";
+      try {
+        tdmsfile f( filename, v.opts );
+        collector c;
+        load( f, "segment", c );
+        check_ranges( f, c, what );
+        check_reads( f, fx, what );
+        check_ids( f, what );
+        check_tree( f, fx, what );
+        if ( fx.check_file ) {
+          fx.check_file( f, what );
+        }
+      }
+      catch ( std::exception& e ) {
+        check( false, what + ": " + e.what( ) );
+      }
+
+      // a file that grows after it's opened
+      what = fx.name + " " + v.name + " refresh";
+      try {
+        std::string growing = directory + "/" + fx.name + "-growing.tdms";
+        size_t first = fx.segments.size( ) / 2;
+        fx.write( growing, first );
+        tdmsfile f( growing, v.opts );
+        fx.write( growing, fx.segments.size( ) );
+        check( f.refresh( ) == fx.segments.size( ) - first, what + ": number of new segments" );
+        collector c;
+        load( f, "segment", c );
+        check_values( fx.values, c.values, what );
+        check_values( fx.strings, c.strings, what );
+        check_ranges( f, c, what );
+        check_reads( f, fx, what );
+      }
+      catch ( std::exception& e ) {
+        check( false, what + ": " + e.what( ) );
+      }
+    }
+  }
+
+  const std::map<std::string, std::function<fixture( )>> fixtures = {
+    { "runs", runs },
+    { "stale_index", stale_index },
+    { "layouts", layouts },
+    { "many_channels", many_channels },
+    { "interleaved", interleaved },
+    { "big_endian", big_endian },
+    { "strings", strings },
+    { "daqmx", [] { return daqmx( false ); } },
+    { "daqmx_big_endian", [] { return daqmx( true ); } },
+    { "daqmx_indexes", daqmx_indexes },
+    { "extended", extended_floats },
+    { "timestamps", timestamps },
+    { "units", units },
+    { "scaling", scales }
+  };
+
+  // checks that need no file
+  const std::map<std::string, std::function<void( )>> checks = {
+    { "extended_kernel", check_extended_kernel },
+    { "timestamp_kernels", check_timestamp_kernels },
+    { "conversions", check_conversions }
+  };
+}
+
+int main( int argc, char ** argv ) {
+  if ( argc != 3 || ( fixtures.end( ) == fixtures.find( argv[2] ) && checks.end( ) == checks.find( argv[2] ) ) ) {
+    std::cerr << "Usage: " << argv[0] << " <directory> <fixture or check>" << std::endl;
+    return 2;
+  }
+  if ( checks.end( ) != checks.find( argv[2] ) ) {
+    checks.at( argv[2] )( );
+  }
+  else {
+    std::filesystem::create_directories( argv[1] );
+    run( fixtures.at( argv[2] )( ), argv[1] );
+  }
+  if ( failures > 0 ) {
+    std::cerr << failures << " checks failed" << std::endl;
+    return 1;
+  }
+  return 0;
+}